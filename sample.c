@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
+#include <sys/prctl.h>
 
 #include "sample.h"
 
@@ -86,3 +87,40 @@ int test_goodbye(int argc, char *argv[])
         printf("goodbye!!\n");
     return EXIT_SUCCESS;
 }
+
+int datatest_divide(int argc, char *argv[])
+{
+    if (argc != 3)
+        return EXIT_FAILURE;
+    int quotient = atoi(argv[0]) / atoi(argv[1]); // SIGFPE if divided by zero
+    return (quotient == atoi(argv[2])) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int fuzztest_argc(int argc, char *argv[])
+{
+    return argc; // a new exit status for each number of arguments
+}
+
+int isolatetest_orphan(int argc, char *argv[])
+{
+    if (fork() == 0)
+    {
+        prctl(PR_SET_NAME, "testfw-orphan");
+        sleep(2); // still running after the test is over
+        exit(EXIT_SUCCESS);
+    }
+    return EXIT_SUCCESS;
+}
+
+int alloctest_balanced(int argc, char *argv[])
+{
+    for (int i = 0; i < 10; i++)
+        free(malloc(100));
+    return EXIT_SUCCESS;
+}
+
+int alloctest_leak(int argc, char *argv[])
+{
+    char *buf = malloc(1000); // never freed
+    return buf ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -65,4 +65,29 @@ int othertest_success(int argc, char *argv[]);
  */
 int othertest_failure(int argc, char *argv[]);
 
+/**
+ * @brief check that "argv[0] / argv[1] == argv[2]" (data-driven test)
+ */
+int datatest_divide(int argc, char *argv[]);
+
+/**
+ * @brief return the number of arguments (fuzzing grows its corpus up to the maximal number of arguments)
+ */
+int fuzztest_argc(int argc, char *argv[]);
+
+/**
+ * @brief leave a process behind (killed in isolation mode)
+ */
+int isolatetest_orphan(int argc, char *argv[]);
+
+/**
+ * @brief allocate and free 10 blocks
+ */
+int alloctest_balanced(int argc, char *argv[]);
+
+/**
+ * @brief leak a block of 1000 bytes
+ */
+int alloctest_leak(int argc, char *argv[]);
+
 #endif
\ No newline at end of file
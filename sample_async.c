@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <poll.h>
+#include "testfw.h"
+#include "sample.h"
+
+#define TIMEOUT 2
+#define LOGFILE NULL
+#define SILENT false
+#define VERBOSE false
+#define COMMAND NULL
+#define NRUNS 3
+#define CANCEL_DELAY 100 /* in ms */
+
+int main(int argc, char *argv[])
+{
+    /* several test frameworks run concurrently in an event loop */
+    struct testfw_t *fws[NRUNS];
+    for (int i = 0; i < NRUNS; i++)
+        fws[i] = testfw_init(argv[0], TIMEOUT, LOGFILE, COMMAND, SILENT, VERBOSE);
+    testfw_register_symb(fws[0], "test", "success");
+    testfw_register_symb(fws[0], "test", "failure");
+    testfw_register_symb(fws[0], "test", "segfault");
+    testfw_register_suite(fws[1], "othertest");
+    testfw_register_symb(fws[2], "test", "sleep"); // cancelled
+    if (argc > 1)
+        testfw_set_statefile(fws[0], argv[1]); // failed tests run first, results keep the index of the host
+
+    struct testfw_run_t *runs[NRUNS];
+    runs[0] = testfw_run_start(fws[0], 0, argv + argc, TESTFW_FORKP);
+    runs[1] = testfw_run_start(fws[1], 0, argv + argc, TESTFW_FORKS);
+    runs[2] = testfw_run_start(fws[2], 0, argv + argc, TESTFW_FORKS);
+
+    struct pollfd fds[NRUNS];
+    for (int i = 0; i < NRUNS; i++)
+    {
+        fds[i].fd = testfw_run_fd(runs[i]);
+        fds[i].events = POLLIN;
+    }
+    int nrunning = NRUNS;
+    while (nrunning > 0)
+    {
+        int n = poll(fds, NRUNS, CANCEL_DELAY);
+        if (n == 0 && fds[2].fd >= 0) // still responsive while tests are running
+        {
+            testfw_cancel(runs[2]);
+            printf("run %d: cancelled\n", 2);
+            fds[2].fd = -1;
+            nrunning--;
+        }
+        for (int i = 0; i < NRUNS && n > 0; i++)
+        {
+            if (fds[i].fd < 0 || !fds[i].revents)
+                continue;
+            struct testfw_result_t res;
+            if (testfw_next_result(runs[i], &res))
+            {
+                struct test_t *t = testfw_get(fws[i], res.index);
+                printf("run %d: %s.%s status %d signal %d in %.2f ms\n", i, t->suite, t->name, res.status, res.signal,
+                       res.mtime);
+            }
+            else
+            {
+                fds[i].fd = -1; // run is over
+                nrunning--;
+            }
+        }
+    }
+
+    for (int i = 0; i < NRUNS; i++)
+    {
+        printf("run %d: %d failures\n", i, testfw_run_end(runs[i]));
+        testfw_free(fws[i]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,41 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "testfw.hpp"
+
+TESTFW_TEST(cpptest, hello)
+{
+    printf("hello from C++!\n");
+    return EXIT_SUCCESS;
+}
+
+/* typed test, registered as "cpptest.zero[int]", "cpptest.zero[long]", ... */
+template <>
+inline std::string testfw::type_name<std::string>()
+{
+    return "string";
+}
+
+TESTFW_TYPED_TEST(cpptest, zero, int, long, double, std::string)
+{
+    T x{};
+    return (x == T()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* value-parameterized tests, registered as "cpptest.square[0]", ... and "cpptest.prime[2]", ... */
+constexpr int squares[][2] = {{0, 0}, {1, 1}, {2, 4}, {3, 9}};
+
+TESTFW_VALUE_TEST(cpptest, square, squares)
+{
+    return (param[0] * param[0] == param[1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+constexpr int primes[] = {2, 3, 5, 7, 9}; // 9 is not prime
+
+TESTFW_VALUE_TEST(cpptest, prime, primes)
+{
+    for (int d = 2; d * d <= param; d++)
+        if (param % d == 0)
+            return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* tests of a component, loaded in a test program with "--lib libsample_lib.so" */
+
+static int square(int x)
+{
+    return x * x;
+}
+
+int test_square(int argc, char *argv[])
+{
+    return (square(-3) == 9) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int test_concat(int argc, char *argv[])
+{
+    char s[16];
+    snprintf(s, sizeof(s), "%s%s", "hello", "!");
+    return (strcmp(s, "hello!") == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int othertest_abort(int argc, char *argv[])
+{
+    abort();
+    return EXIT_SUCCESS;
+}
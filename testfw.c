@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,12 +11,32 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <sched.h>
+#include <math.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#endif
 #include <assert.h>
 #include <dlfcn.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <sys/mman.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <elf.h>
+#include <link.h>
+#endif
 
 #include "testfw.h"
+#include "testfw_alloc.h"
+#include "testfw_internal.h"
 
 #define GREEN "\033[0;32m" // Green Color
 #define RED "\033[0;31m"   // Red Color
@@ -23,6 +44,14 @@
 
 /* ********** STRUCTURES ********** */
 
+struct library_t
+{
+    char *path;     /* path of the shared library */
+    char *name;     /* library name, that qualifies its suites as "<name>:<suite>" */
+    void *handle;   /* handle returned by dlopen() */
+    char **symbols; /* symbols defined in this library (discovered), else NULL */
+};
+
 struct testfw_t
 {
     char *program;
@@ -31,11 +60,561 @@ struct testfw_t
     char *cmd;
     bool silent;
     bool verbose;
+    bool cache;
+    char *statefile;
+    char **symbols;
+    int nlibs;                   /* number of test libraries */
+    struct library_t *libs;      /* test libraries */
+    int *cpus;
+    int ncpus;
+    int cpuslot;                 /* CPU slot of the current worker (forkp mode), else -1 */
+    bool bench;
+    bool counters;
+    bool isolate;                /* if true, run each test in its own cgroup or process group */
+    char *cgroup;                /* parent cgroup of tests (created by the framework), else NULL */
+    int cgroupseq;               /* sequence number of test cgroups */
+    char *cgroupbase;            /* cgroup in which the parent cgroup of tests is created, else NULL */
+    pid_t cgrouppid;             /* process that has changed the base cgroup */
+    bool cgroupleft;             /* if true, this process has moved from the base cgroup into its leaf */
+    bool cgroupenabled[2];       /* if true, the memory (resp. cpu) controller is enabled in the base cgroup by us */
+    long long memory_max;        /* memory limit of each test (in bytes), else 0 */
+    double cpu_max;              /* CPU limit of each test (in CPUs), else 0 */
+    bool alloc;                  /* if true, profile heap allocations of each test */
+    long long max_allocs;        /* maximal number of allocations of a test, else -1 */
+    bool fail_on_leak;           /* if true, a test that leaks memory fails */
+    struct alloc_slot_t *allocslots; /* allocation statistics of each test (shared mapping), else NULL */
+    char *incfile;               /* file of passed tests and their hashes (incremental run), else NULL */
+    int nhashfiles;              /* number of extra files hashed with each test */
+    char **hashfiles;            /* extra files hashed with each test */
+    int tracefd;                 /* trace file descriptor, else -1 */
+    pid_t tracepid;              /* process id of the trace */
+    struct timespec tracets;     /* trace origin */
+    int tracelane;               /* trace lane of the current process (0 for the framework) */
+    int tracelanes;              /* number of named trace lanes */
+    int repeat;                  /* number of runs per test */
+    char *baseline;              /* baseline file to compare with, else NULL */
+    char *savebaseline;          /* baseline file to save, else NULL */
+    double threshold;            /* minimal slowdown of the median duration */
+    double alpha;                /* significance level of the slowdown */
+    bool gate;                   /* if true, a slower test is a failure */
+    int resultfd;                /* write end of the result pipe (forkp mode), else -1 */
+    int reportfd;                /* write end of the report pipe (asynchronous run), else -1 */
+    int *order;                  /* index of each test before failed tests are moved first (see statefile), or NULL */
     int size;
     int capacity;
     struct test_t *tests;
 };
 
+/* ********** I/O ********** */
+
+bool testfw_read_full(int fd, void *buf, size_t size)
+{
+    for (size_t n = 0; n < size;)
+    {
+        ssize_t r = read(fd, (char *)buf + n, size - n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        n += r;
+    }
+    return true;
+}
+
+bool testfw_write_full(int fd, const void *buf, size_t size)
+{
+    for (size_t n = 0; n < size;)
+    {
+        ssize_t w = write(fd, (const char *)buf + n, size - n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        n += w;
+    }
+    return true;
+}
+
+/* ********** TIME & CPU PLACEMENT ********** */
+
+/* elapsed time since ts_start (in ms), measured with a monotonic clock */
+static double mtime_since(struct timespec *ts_start)
+{
+    struct timespec ts_end;
+    clock_gettime(CLOCK_MONOTONIC, &ts_end);
+    return (ts_end.tv_sec - ts_start->tv_sec) * 1000.0 + (ts_end.tv_nsec - ts_start->tv_nsec) / 1000000.0; // in ms
+}
+
+/* pin the calling process on the k-th CPU of the allowed set (round-robin), if any */
+static void pin_cpu(struct testfw_t *fw, int k)
+{
+#if defined(__linux__)
+    if (fw->ncpus == 0)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(fw->cpus[k % fw->ncpus], &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+/* in benchmark mode, test output is discarded (unless redirected elsewhere) */
+static void bench_output(struct testfw_t *fw)
+{
+    if (!fw->bench || fw->logfile || fw->cmd)
+        return;
+    int fd = open("/dev/null", O_WRONLY);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+}
+
+/* ********** PERFORMANCE COUNTERS ********** */
+
+/**
+ * Counters are opened with perf_event_open() on a test process (and its future children). Hardware counters are used
+ * when available, else software counters (e.g. in virtual machines or containers). Values are scaled if the counter was
+ * multiplexed.
+ */
+
+static const char *counter_names[TESTFW_NCOUNTERS] = {"instructions", "cycles", "cache-misses", "branch-misses",
+                                                      "task-clock", "page-faults", "context-switches"};
+
+static void open_counters(struct testfw_t *fw, pid_t pid, int *fds)
+{
+    for (int k = 0; k < TESTFW_NCOUNTERS; k++)
+        fds[k] = -1;
+#if defined(__linux__)
+    if (!fw->counters)
+        return;
+    static const unsigned long long configs[TESTFW_NCOUNTERS] = {
+        PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES};
+    bool hardware = false;
+    for (int k = 0; k < TESTFW_NCOUNTERS; k++)
+    {
+        bool hw = (k < TESTFW_COUNTER_TASK_CLOCK);
+        if (!hw && hardware)
+            break; /* software counters are only a fallback */
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = hw ? PERF_TYPE_HARDWARE : PERF_TYPE_SOFTWARE;
+        attr.config = configs[k];
+        attr.inherit = 1;
+        attr.exclude_kernel = hw; /* required if perf_event_paranoid >= 2 */
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[k] = syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        hardware |= (hw && fds[k] >= 0);
+    }
+#endif
+}
+
+static void close_counters(int *fds, long long *counters)
+{
+    for (int k = 0; k < TESTFW_NCOUNTERS; k++)
+    {
+        unsigned long long value[3]; /* value, time enabled, time running */
+        counters[k] = -1;
+        if (fds[k] < 0)
+            continue;
+        if (read(fds[k], value, sizeof(value)) == sizeof(value))
+        {
+            if (value[2] > 0 && value[2] < value[1]) // multiplexed
+                counters[k] = (long long)((double)value[0] * value[1] / value[2]);
+            else
+                counters[k] = (long long)value[0];
+        }
+        close(fds[k]);
+    }
+}
+
+/* format available counters as "name value, ..." (or as JSON members if json) */
+static void format_counters(long long *counters, char *buf, size_t size, bool json)
+{
+    *buf = 0;
+    for (int k = 0; k < TESTFW_NCOUNTERS; k++)
+    {
+        if (counters[k] < 0)
+            continue;
+        size_t len = strlen(buf);
+        if (json)
+            snprintf(buf + len, size - len, ",\"%s\":%lld", counter_names[k], counters[k]);
+        else
+            snprintf(buf + len, size - len, "%s%s %lld", len ? ", " : "", counter_names[k], counters[k]);
+    }
+}
+
+/* ********** ISOLATION ********** */
+
+/**
+ * Each test runs in its own child cgroup (v2), created in a delegated subtree. On timeout, the whole process tree is
+ * killed atomically with cgroup.kill, and the peak memory and CPU usage of the tree are read back before the cgroup is
+ * removed. Without cgroup, each test runs in its own process group, killed with killpg(). In both cases, processes left
+ * behind by a test are killed as soon as it is over.
+ */
+
+static bool cgroup_write(char *cgroup, char *file, char *value)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", cgroup, file);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool ok = (write(fd, value, strlen(value)) == (ssize_t)strlen(value));
+    int err = errno;
+    close(fd);
+    errno = err; // e.g. EBUSY
+    return ok;
+}
+
+/* read the value of a key in a cgroup file (or the first value if key is NULL), else -1 */
+static long long cgroup_read(char *cgroup, char *file, char *key)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", cgroup, file);
+    FILE *stream = fopen(path, "re");
+    if (!stream)
+        return -1;
+    long long value = -1;
+    char name[64];
+    long long v;
+    if (!key)
+        value = (fscanf(stream, "%lld", &v) == 1) ? v : -1;
+    else
+        while (fscanf(stream, "%63s %lld", name, &v) == 2)
+            if (strcmp(name, key) == 0)
+            {
+                value = v;
+                break;
+            }
+    fclose(stream);
+    return value;
+}
+
+/* find the cgroup v2 of the framework, if it can be used to create child cgroups */
+static char *cgroup_detect(void)
+{
+    char mount[PATH_MAX] = "";
+    char line[PATH_MAX + 64];
+    FILE *stream = fopen("/proc/self/mounts", "re");
+    if (!stream)
+        return NULL;
+    while (fgets(line, sizeof(line), stream))
+    {
+        char dir[PATH_MAX], type[64];
+        if (sscanf(line, "%*s %4095s %63s", dir, type) == 2 && strcmp(type, "cgroup2") == 0)
+        {
+            strcpy(mount, dir);
+            break;
+        }
+    }
+    fclose(stream);
+    if (!*mount)
+        return NULL;
+
+    char *cgroup = NULL;
+    stream = fopen("/proc/self/cgroup", "re");
+    if (!stream)
+        return NULL;
+    while (fgets(line, sizeof(line), stream))
+        if (strncmp(line, "0::", 3) == 0)
+        {
+            line[strcspn(line, "\n")] = 0;
+            int r = asprintf(&cgroup, "%s%s", mount, strcmp(line + 3, "/") ? line + 3 : "");
+            assert(r != -1);
+            break;
+        }
+    fclose(stream);
+
+    char procs[PATH_MAX];
+    snprintf(procs, sizeof(procs), "%s/cgroup.procs", cgroup ? cgroup : "");
+    if (cgroup && (access(cgroup, W_OK) || access(procs, W_OK)))
+    {
+        free(cgroup);
+        cgroup = NULL;
+    }
+    return cgroup;
+}
+
+/* return true if a controller is enabled for the children of a cgroup */
+static bool cgroup_enabled(char *cgroup, char *controller)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", cgroup);
+    FILE *stream = fopen(path, "re");
+    if (!stream)
+        return false;
+    bool enabled = false;
+    char name[64];
+    while (!enabled && fscanf(stream, "%63s", name) == 1)
+        enabled = (strcmp(name, controller) == 0);
+    fclose(stream);
+    return enabled;
+}
+
+/* the leaf cgroup "<cgroup>/testfw-<pid>-framework" of this process */
+static void cgroup_leaf(char *cgroup, char *leaf, size_t size)
+{
+    snprintf(leaf, size, "%s/testfw-%d-framework", cgroup, getpid());
+}
+
+/* move this process from a cgroup into its leaf cgroup */
+static bool cgroup_leave(char *cgroup)
+{
+    char leaf[PATH_MAX];
+    char pid[32];
+    cgroup_leaf(cgroup, leaf, sizeof(leaf));
+    snprintf(pid, sizeof(pid), "%d", getpid());
+    if (mkdir(leaf, 0755) == -1 && errno != EEXIST)
+        return false;
+    if (cgroup_write(leaf, "cgroup.procs", pid))
+        return true;
+    rmdir(leaf);
+    return false;
+}
+
+/* undo the changes of the framework in its base cgroup (once tests cgroups are removed): disable the controllers that
+   it has enabled, and move this process back from its leaf cgroup */
+static void cgroup_restore(struct testfw_t *fw)
+{
+    if (fw->cgrouppid != getpid()) // e.g. a forked child
+        return;
+    char *controllers[] = {"-memory", "-cpu"};
+    for (int i = 0; i < 2; i++)
+        if (fw->cgroupenabled[i])
+            cgroup_write(fw->cgroupbase, "cgroup.subtree_control", controllers[i]); // may fail if still in use
+    if (fw->cgroupleft)
+    {
+        char leaf[PATH_MAX];
+        char pid[32];
+        cgroup_leaf(fw->cgroupbase, leaf, sizeof(leaf));
+        snprintf(pid, sizeof(pid), "%d", getpid());
+        if (cgroup_write(fw->cgroupbase, "cgroup.procs", pid))
+            rmdir(leaf);
+    }
+}
+
+/* create a child cgroup for a test with its limits, or return NULL if cgroups are not used */
+static char *cgroup_create(struct testfw_t *fw)
+{
+    if (!fw->cgroup)
+        return NULL;
+    char *cgroup = NULL;
+    int r = asprintf(&cgroup, "%s/test-%d-%d", fw->cgroup, getpid(), fw->cgroupseq++);
+    assert(r != -1);
+    if (mkdir(cgroup, 0755) == -1)
+    {
+        fprintf(stderr, "Error: cannot create cgroup \"%s\"!\n", cgroup);
+        exit(EXIT_FAILURE);
+    }
+    char value[64];
+    snprintf(value, sizeof(value), "%lld", fw->memory_max);
+    if (fw->memory_max > 0 && !cgroup_write(cgroup, "memory.max", value))
+    {
+        fprintf(stderr, "Error: cannot set memory.max in cgroup \"%s\"!\n", cgroup);
+        exit(EXIT_FAILURE);
+    }
+    snprintf(value, sizeof(value), "%lld 100000", (long long)(fw->cpu_max * 100000));
+    if (fw->cpu_max > 0 && !cgroup_write(cgroup, "cpu.max", value))
+    {
+        fprintf(stderr, "Error: cannot set cpu.max in cgroup \"%s\"!\n", cgroup);
+        exit(EXIT_FAILURE);
+    }
+    return cgroup;
+}
+
+/* kill all processes of a test, that must not be reaped yet (so that its process group cannot be reused) */
+static void kill_test(char *cgroup, pid_t pid)
+{
+    if (cgroup && cgroup_write(cgroup, "cgroup.kill", "1"))
+        return;
+    kill(-pid, SIGKILL);
+    kill(pid, SIGKILL); // in case the test has changed its process group
+}
+
+static void cgroup_rmdir(char *cgroup)
+{
+    for (int k = 0; rmdir(cgroup) == -1 && errno == EBUSY && k < 1000; k++)
+        usleep(1000); // killed processes are not yet over
+}
+
+/* read resource usage of a test and remove its cgroup, once all its processes are killed */
+static void cgroup_remove(char *cgroup, struct testfw_result_t *res)
+{
+    res->memory = -1;
+    res->cpu = -1;
+    if (!cgroup)
+        return;
+    res->memory = cgroup_read(cgroup, "memory.peak", NULL);
+    res->cpu = cgroup_read(cgroup, "cpu.stat", "usage_usec");
+    cgroup_rmdir(cgroup);
+    free(cgroup);
+}
+
+/* remove the parent cgroup of tests, and the cgroups of tests left behind by a cancelled run */
+static void cgroup_cleanup(char *cgroup)
+{
+    DIR *dir = opendir(cgroup);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)))
+        if (entry->d_type == DT_DIR && strncmp(entry->d_name, "test-", 5) == 0)
+        {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", cgroup, entry->d_name);
+            cgroup_write(path, "cgroup.kill", "1");
+            cgroup_rmdir(path);
+        }
+    if (dir)
+        closedir(dir);
+    cgroup_rmdir(cgroup);
+}
+
+/* ********** ALLOCATION PROFILING ********** */
+
+/**
+ * The allocation routines are interposed by a separate object (see testfw_alloc.c), that is only linked in programs that
+ * profile allocations, so that other programs keep their allocator (e.g. AddressSanitizer). The framework reaches it
+ * through weak symbols: if it is not linked, allocation profiling is not available.
+ */
+
+#pragma weak testfw_alloc_start
+#pragma weak testfw_alloc_stop
+
+static bool alloc_available(void)
+{
+    return testfw_alloc_start != NULL && testfw_alloc_stop != NULL;
+}
+
+/* start counting the allocations of a test in its slot */
+static void alloc_start(struct alloc_slot_t *slot)
+{
+    if (slot && alloc_available())
+        testfw_alloc_start(slot);
+}
+
+/* stop counting allocations, once the test function returns */
+static void alloc_stop(struct alloc_slot_t *slot)
+{
+    if (slot && alloc_available())
+        testfw_alloc_stop(slot);
+}
+
+/* get the allocation statistics of a test from its slot, else -1 if not available */
+static void alloc_result(struct alloc_slot_t *slot, struct testfw_result_t *res)
+{
+    if (!slot)
+    {
+        res->allocs = res->allocated = res->peak = res->leaked = -1;
+        return;
+    }
+    long long live = slot->main.live + slot->threads.live;
+    res->allocs = slot->main.nallocs + slot->threads.nallocs;
+    res->allocated = slot->main.allocated + slot->threads.allocated;
+    res->peak = (slot->main.peak > slot->threads.peak) ? slot->main.peak : slot->threads.peak;
+    res->leaked = (live > 0) ? live : 0; // memory inherited from the framework may be freed by the test
+}
+
+/* status of a successful test that exceeds an allocation threshold (a failure), else NULL */
+static char *alloc_check(struct testfw_t *fw, long long allocs, long long leaked)
+{
+    if (!fw->alloc)
+        return NULL;
+    if (fw->fail_on_leak && leaked > 0)
+        return "LEAKED";
+    if (fw->max_allocs >= 0 && allocs > fw->max_allocs)
+        return "ALLOCS";
+    return NULL;
+}
+
+/* format a number of bytes in a human-readable way */
+static void format_bytes(long long bytes, char *buf, size_t size)
+{
+    if (bytes < 1024)
+        snprintf(buf, size, "%lld B", bytes);
+    else if (bytes < 1024 * 1024)
+        snprintf(buf, size, "%.1f KiB", bytes / 1024.0);
+    else
+        snprintf(buf, size, "%.1f MiB", bytes / (1024.0 * 1024.0));
+}
+
+/* ********** TRACE ********** */
+
+/**
+ * Trace events are written in the Chrome trace-event format (JSON array of complete events), that can be opened in
+ * Perfetto or about:tracing. Each event is written with a single write() on a file opened in append mode, so that
+ * forked processes can share the trace file. All events belong to the same process, and lanes are used as threads:
+ * lane 0 for the framework and lanes 1..N for workers. When tracing is disabled, trace routines just return.
+ */
+
+/* escape a string for JSON (quotes, backslashes and control characters), truncated to the buffer size */
+static char *json_escape(const char *str, char *buf, size_t size)
+{
+    assert(size > 0);
+    size_t n = 0;
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++)
+    {
+        char esc[8];
+        if (*c == '"' || *c == '\\')
+            snprintf(esc, sizeof(esc), "\\%c", *c);
+        else if (*c < 0x20)
+            snprintf(esc, sizeof(esc), "\\u%04x", *c);
+        else
+            snprintf(esc, sizeof(esc), "%c", *c);
+        size_t len = strlen(esc);
+        if (n + len >= size)
+            break;
+        memcpy(buf + n, esc, len);
+        n += len;
+    }
+    buf[n] = 0;
+    return buf;
+}
+
+static inline void trace_begin(struct testfw_t *fw, struct timespec *ts)
+{
+    if (fw->tracefd >= 0)
+        clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+/* name lanes up to the given lane (metadata events) */
+static void trace_lane(struct testfw_t *fw, int lane)
+{
+    for (; fw->tracefd >= 0 && fw->tracelanes <= lane; fw->tracelanes++)
+    {
+        if (fw->tracelanes == 0)
+            dprintf(fw->tracefd, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"framework\"}}", fw->tracepid);
+        else
+            dprintf(fw->tracefd, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", fw->tracepid, fw->tracelanes, fw->tracelanes);
+    }
+}
+
+/* write a complete event from ts_start to now on a given lane; args is a JSON object or NULL */
+static void trace_event(struct testfw_t *fw, int lane, struct timespec *ts_start, char *cat, char *name, char *args)
+{
+    if (fw->tracefd < 0)
+        return;
+    struct timespec ts_end;
+    clock_gettime(CLOCK_MONOTONIC, &ts_end);
+    double ts = (ts_start->tv_sec - fw->tracets.tv_sec) * 1e6 + (ts_start->tv_nsec - fw->tracets.tv_nsec) / 1e3; // in us
+    double dur = (ts_end.tv_sec - ts_start->tv_sec) * 1e6 + (ts_end.tv_nsec - ts_start->tv_nsec) / 1e3;
+    char buf[1024];
+    char ename[384], ecat[64];
+    int len = snprintf(buf, sizeof(buf), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f%s%s}",
+                       json_escape(name, ename, sizeof(ename)), json_escape(cat, ecat, sizeof(ecat)), fw->tracepid, lane, ts,
+                       dur, args ? ",\"args\":" : "", args ? args : "");
+    if (len > 0 && len < (int)sizeof(buf))
+        write(fw->tracefd, buf, len); // atomic append
+}
+
+/* write a complete event from ts_start to now, on the lane of the current process */
+static void trace_end(struct testfw_t *fw, struct timespec *ts_start, char *cat, char *name, char *args)
+{
+    if (fw->tracefd >= 0)
+        trace_event(fw, fw->tracelane, ts_start, cat, name, args);
+}
+
 /* ********** FRAMEWORK ROUTINES ********** */
 
 struct testfw_t *testfw_init(char *program, int timeout, char *logfile, char *cmd, bool silent, bool verbose)
@@ -49,6 +628,44 @@ struct testfw_t *testfw_init(char *program, int timeout, char *logfile, char *cm
     fw->cmd = cmd ? strdup(cmd) : NULL;
     fw->silent = silent;
     fw->verbose = verbose;
+    fw->cache = false;
+    fw->statefile = NULL;
+    fw->symbols = NULL;
+    fw->nlibs = 0;
+    fw->libs = NULL;
+    fw->cpus = NULL;
+    fw->ncpus = 0;
+    fw->cpuslot = -1;
+    fw->bench = false;
+    fw->counters = false;
+    fw->isolate = false;
+    fw->cgroup = NULL;
+    fw->cgroupseq = 0;
+    fw->cgroupbase = NULL;
+    fw->cgrouppid = 0;
+    fw->cgroupleft = false;
+    fw->cgroupenabled[0] = fw->cgroupenabled[1] = false;
+    fw->memory_max = 0;
+    fw->cpu_max = 0;
+    fw->alloc = false;
+    fw->max_allocs = -1;
+    fw->fail_on_leak = false;
+    fw->allocslots = NULL;
+    fw->incfile = NULL;
+    fw->nhashfiles = 0;
+    fw->hashfiles = NULL;
+    fw->tracefd = -1;
+    fw->tracelane = 0;
+    fw->tracelanes = 0;
+    fw->repeat = 1;
+    fw->baseline = NULL;
+    fw->savebaseline = NULL;
+    fw->threshold = TESTFW_DEFAULT_THRESHOLD;
+    fw->alpha = TESTFW_DEFAULT_ALPHA;
+    fw->gate = false;
+    fw->resultfd = -1;
+    fw->reportfd = -1;
+    fw->order = NULL;
     fw->size = 0;
     fw->capacity = 10;
     fw->tests = malloc(fw->capacity * sizeof(struct test_t));
@@ -59,11 +676,49 @@ struct testfw_t *testfw_init(char *program, int timeout, char *logfile, char *cm
 void testfw_free(struct testfw_t *fw)
 {
     assert(fw);
+    if (fw->tracefd >= 0)
+    {
+        dprintf(fw->tracefd, "\n]\n");
+        close(fw->tracefd);
+    }
+    if (fw->cgroup)
+        cgroup_cleanup(fw->cgroup);
+    if (fw->cgroupbase)
+        cgroup_restore(fw);
+    free(fw->cgroup);
+    free(fw->cgroupbase);
     free(fw->program);
     free(fw->logfile);
     free(fw->cmd);
+    free(fw->statefile);
+    free(fw->order);
+    free(fw->baseline);
+    free(fw->savebaseline);
+    free(fw->incfile);
+    for (int i = 0; i < fw->nhashfiles; i++)
+        free(fw->hashfiles[i]);
+    free(fw->hashfiles);
+    if (fw->symbols)
+        for (char **s = fw->symbols; *s; s++)
+            free(*s);
+    free(fw->symbols);
+    for (int i = 0; i < fw->nlibs; i++)
+    {
+        free(fw->libs[i].path);
+        free(fw->libs[i].name);
+        if (fw->libs[i].symbols)
+            for (char **s = fw->libs[i].symbols; *s; s++)
+                free(*s);
+        free(fw->libs[i].symbols);
+        dlclose(fw->libs[i].handle);
+    }
+    free(fw->libs);
+    free(fw->cpus);
     for (int i = 0; i < fw->size; i++)
+    {
+        free(fw->tests[i].suite);
         free(fw->tests[i].name);
+    }
     free(fw->tests);
     free(fw);
 }
@@ -80,6 +735,265 @@ struct test_t *testfw_get(struct testfw_t *fw, int k)
     assert(k >= 0 && k < fw->size);
     return fw->tests + k;
 }
+
+void testfw_set_cache(struct testfw_t *fw, bool cache)
+{
+    assert(fw);
+    fw->cache = cache;
+}
+
+void testfw_set_statefile(struct testfw_t *fw, char *statefile)
+{
+    assert(fw);
+    free(fw->statefile);
+    fw->statefile = statefile ? strdup(statefile) : NULL;
+}
+
+void testfw_set_affinity(struct testfw_t *fw, char *cpulist, bool reserve)
+{
+    assert(fw);
+#if defined(__linux__)
+    cpu_set_t allowed, set;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    CPU_ZERO(&set);
+    if (!cpulist)
+        set = allowed;
+    else
+    {
+        /* parse a list of CPUs, such as "0-3,6" */
+        char *list = strdup(cpulist);
+        assert(list);
+        for (char *range = strtok(list, ","); range; range = strtok(NULL, ","))
+        {
+            int first = -1, last = -1;
+            int n = sscanf(range, "%d-%d", &first, &last);
+            if (n == 1)
+                last = first;
+            if (n < 1 || first < 0 || last < first || last >= CPU_SETSIZE)
+            {
+                fprintf(stderr, "Error: invalid CPU list \"%s\"!\n", cpulist);
+                exit(EXIT_FAILURE);
+            }
+            for (int cpu = first; cpu <= last; cpu++)
+                CPU_SET(cpu, &set);
+        }
+        free(list);
+        CPU_AND(&set, &set, &allowed);
+    }
+
+    free(fw->cpus);
+    fw->cpus = calloc(CPU_COUNT(&set), sizeof(int));
+    assert(fw->cpus);
+    fw->ncpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            fw->cpus[fw->ncpus++] = cpu;
+    if (fw->ncpus == 0)
+    {
+        fprintf(stderr, "Error: no CPU available!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* the first CPU is reserved for the framework itself, and tests run on the others */
+    if (reserve && fw->ncpus < 2)
+        fprintf(stderr, "Warning: cannot reserve a CPU for the framework (only one CPU available)!\n");
+    else if (reserve)
+    {
+        pin_cpu(fw, 0);
+        fw->ncpus--;
+        memmove(fw->cpus, fw->cpus + 1, fw->ncpus * sizeof(int));
+    }
+#else
+    fprintf(stderr, "Warning: CPU affinity is not supported on this system!\n");
+#endif
+}
+
+void testfw_set_trace(struct testfw_t *fw, char *tracefile)
+{
+    assert(fw && tracefile);
+    if (fw->tracefd >= 0)
+        close(fw->tracefd);
+    fw->tracefd = open(tracefile, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fw->tracefd < 0)
+    {
+        perror(tracefile);
+        exit(EXIT_FAILURE);
+    }
+    fw->tracepid = getpid();
+    clock_gettime(CLOCK_MONOTONIC, &fw->tracets);
+    fw->tracelanes = 0;
+    char program[PATH_MAX];
+    json_escape(fw->program, program, sizeof(program));
+    dprintf(fw->tracefd, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"testfw %s\"}}", fw->tracepid, program);
+    trace_lane(fw, 0);
+}
+
+void testfw_set_repeat(struct testfw_t *fw, int repeat)
+{
+    assert(fw && repeat > 0);
+    fw->repeat = repeat;
+}
+
+void testfw_set_baseline(struct testfw_t *fw, char *baseline, char *savebaseline, double threshold, double alpha, bool gate)
+{
+    assert(fw);
+    assert(threshold >= 1.0 && alpha > 0.0 && alpha < 1.0);
+    free(fw->baseline);
+    free(fw->savebaseline);
+    fw->baseline = baseline ? strdup(baseline) : NULL;
+    fw->savebaseline = savebaseline ? strdup(savebaseline) : NULL;
+    fw->threshold = threshold;
+    fw->alpha = alpha;
+    fw->gate = gate;
+}
+
+void testfw_set_isolation(struct testfw_t *fw, char *cgroup, long long memory_max, double cpu_max)
+{
+    assert(fw);
+    fw->isolate = true;
+    char *base = cgroup ? strdup(cgroup) : cgroup_detect();
+    char leaf[PATH_MAX];
+    if (!cgroup && base)
+    {
+        cgroup_leaf("", leaf, sizeof(leaf));
+        size_t n = strlen(base), m = strlen(leaf);
+        if (n > m && strcmp(base + n - m, leaf) == 0)
+            base[n - m] = 0; // another framework of this process has moved into its leaf
+    }
+    if (cgroup && access(cgroup, W_OK))
+    {
+        fprintf(stderr, "Error: cannot use cgroup \"%s\"!\n", cgroup);
+        exit(EXIT_FAILURE);
+    }
+    if (base)
+    {
+        static int nframeworks = 0; // several frameworks may be isolated in a process
+        int r = asprintf(&fw->cgroup, "%s/testfw-%d-%d", base, getpid(), nframeworks++);
+        assert(r != -1);
+        if (mkdir(fw->cgroup, 0755) == -1)
+        {
+            if (cgroup)
+            {
+                fprintf(stderr, "Error: cannot create cgroup in \"%s\"!\n", cgroup);
+                exit(EXIT_FAILURE);
+            }
+            free(fw->cgroup);
+            fw->cgroup = NULL; // fall back to process groups
+        }
+    }
+    if ((memory_max > 0 || cpu_max > 0) && !fw->cgroup)
+    {
+        fprintf(stderr, "Error: resource limits require a cgroup v2!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /**
+     * Controllers are enabled for test cgroups if possible (to read peak memory), else required for limits. They must be
+     * enabled in the base cgroup first, but a cgroup that holds processes (except the root) cannot enable controllers
+     * for its children: if the base cgroup is the one of the framework, the framework moves into a leaf cgroup. Both
+     * changes are undone by testfw_free().
+     */
+    if (fw->cgroup)
+    {
+        char *own = cgroup_detect();
+        bool self = own && strcmp(own, base) == 0;
+        free(own);
+        fw->cgroupbase = strdup(base);
+        fw->cgrouppid = getpid();
+        char *names[] = {"memory", "cpu"};
+        char *controllers[] = {"+memory", "+cpu"};
+        for (int i = 0; i < 2; i++)
+        {
+            if (cgroup_enabled(base, names[i]))
+                continue; // e.g. by a delegating manager, or another framework
+            bool enabled = cgroup_write(base, "cgroup.subtree_control", controllers[i]);
+            if (!enabled && errno == EBUSY && self && (fw->cgroupleft || cgroup_leave(base)))
+            {
+                fw->cgroupleft = true;
+                enabled = cgroup_write(base, "cgroup.subtree_control", controllers[i]);
+            }
+            fw->cgroupenabled[i] = enabled;
+        }
+        bool memory = cgroup_write(fw->cgroup, "cgroup.subtree_control", "+memory");
+        bool cpu = cgroup_write(fw->cgroup, "cgroup.subtree_control", "+cpu");
+        if ((memory_max > 0 && !memory) || (cpu_max > 0 && !cpu))
+        {
+            fprintf(stderr, "Error: cannot enable %s controller in cgroup \"%s\" (not delegated?)!\n",
+                    (memory_max > 0 && !memory) ? "memory" : "cpu", fw->cgroup);
+            rmdir(fw->cgroup);
+            cgroup_restore(fw);
+            exit(EXIT_FAILURE);
+        }
+        if (!memory) // cpu.stat is always available
+            fprintf(stderr, "Warning: cannot enable memory controller in cgroup \"%s\", peak memory is not measured!\n",
+                    fw->cgroup);
+    }
+    fw->memory_max = memory_max;
+    fw->cpu_max = cpu_max;
+    free(base);
+}
+
+void testfw_set_counters(struct testfw_t *fw, bool counters)
+{
+    assert(fw);
+    fw->counters = counters;
+}
+
+void testfw_set_alloc(struct testfw_t *fw, bool alloc, long long max_allocs, bool fail_on_leak)
+{
+    assert(fw);
+    if (alloc && !alloc_available())
+    {
+        fprintf(stderr, "Error: allocation profiling requires to link the testfw_alloc object (glibc only)!\n");
+        exit(EXIT_FAILURE);
+    }
+    fw->alloc = alloc;
+    fw->max_allocs = max_allocs;
+    fw->fail_on_leak = fail_on_leak;
+}
+
+void testfw_set_incremental(struct testfw_t *fw, bool incremental, char *incfile)
+{
+    assert(fw);
+    free(fw->incfile);
+    fw->incfile = NULL;
+    if (!incremental)
+        return;
+#if defined(__linux__)
+    if (incfile)
+        fw->incfile = strdup(incfile);
+    else
+        asprintf(&fw->incfile, "%s.testfw-incremental", fw->program);
+    assert(fw->incfile);
+#else
+    fprintf(stderr, "Warning: incremental runs are not supported on this platform!\n");
+#endif
+}
+
+void testfw_add_hash_file(struct testfw_t *fw, char *path)
+{
+    assert(fw && path);
+    fw->hashfiles = realloc(fw->hashfiles, (fw->nhashfiles + 1) * sizeof(char *));
+    assert(fw->hashfiles);
+    fw->hashfiles[fw->nhashfiles] = strdup(path);
+    assert(fw->hashfiles[fw->nhashfiles]);
+    fw->nhashfiles++;
+}
+
+void testfw_set_bench(struct testfw_t *fw, bool bench)
+{
+    assert(fw);
+    fw->bench = bench;
+    /* raise the priority of the framework and all its tests (requires privileges) */
+    static bool warned = false;
+    if (bench && setpriority(PRIO_PROCESS, 0, -20) < 0 && fw->verbose && !warned)
+    {
+        perror("Warning: cannot raise priority");
+        warned = true;
+    }
+}
+
 static struct test_t *add_test(struct testfw_t *fw, char *suite, char *name, testfw_func_t func)
 {
     assert(fw && fw->size <= fw->capacity);
@@ -133,34 +1047,429 @@ static char *test2func(char *suite, char *name)
     return funcname;
 }
 
-struct test_t *testfw_register_symb(struct testfw_t *fw, char *suite, char *name)
+/* find the test library of a suite qualified as "<lib>:<suite>", and skip this qualifier; else return NULL */
+static struct library_t *find_library(struct testfw_t *fw, char **suite)
 {
-    assert(fw);
+    char *sep = strchr(*suite, ':');
+    if (!sep)
+        return NULL;
+    for (int i = 0; i < fw->nlibs; i++)
+        if (strlen(fw->libs[i].name) == (size_t)(sep - *suite) && strncmp(fw->libs[i].name, *suite, sep - *suite) == 0)
+        {
+            *suite = sep + 1;
+            return &fw->libs[i];
+        }
+    fprintf(stderr, "Error: test library of suite \"%s\" not loaded!\n", *suite);
+    exit(EXIT_FAILURE);
+}
+
+void testfw_add_library(struct testfw_t *fw, char *path)
+{
+    assert(fw && path);
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL); /* suites of distinct libraries may have the same name */
+    if (!handle)
+    {
+        fprintf(stderr, "Error: cannot load test library \"%s\" (%s)!\n", path, dlerror());
+        exit(EXIT_FAILURE);
+    }
+    /* library name: "path/libfoo.so.1" is "foo" */
+    char *base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    if (strncmp(base, "lib", 3) == 0 && base[3] && base[3] != '.')
+        base += 3;
+    char *name = strndup(base, strcspn(base, ".:"));
+    assert(name);
+    for (int i = 0; i < fw->nlibs; i++)
+        if (strcmp(fw->libs[i].name, name) == 0)
+        {
+            fprintf(stderr, "Error: test library \"%s\" already loaded!\n", name);
+            exit(EXIT_FAILURE);
+        }
+    fw->libs = realloc(fw->libs, (fw->nlibs + 1) * sizeof(struct library_t));
+    assert(fw->libs);
+    struct library_t *lib = &fw->libs[fw->nlibs++];
+    lib->path = strdup(path);
+    lib->name = name;
+    lib->handle = handle;
+    lib->symbols = NULL; /* discovered on demand */
+}
+
+/* static tests of the program, added before main() (e.g. by C++ static initializers) */
+struct static_test_t
+{
+    char *suite;
+    char *name; /* "name" or "name[param]" */
+    testfw_func_t func;
+};
+
+static struct static_test_t *static_tests = NULL;
+static int nstatic_tests = 0;
+
+void testfw_add_static(const char *suite, const char *name, testfw_func_t func)
+{
+    assert(suite && name && func);
+    static_tests = realloc(static_tests, (nstatic_tests + 1) * sizeof(struct static_test_t));
+    assert(static_tests);
+    static_tests[nstatic_tests].suite = strdup(suite);
+    static_tests[nstatic_tests].name = strdup(name);
+    static_tests[nstatic_tests].func = func;
+    assert(static_tests[nstatic_tests].suite && static_tests[nstatic_tests].name);
+    nstatic_tests++;
+}
+
+/* register the static tests of a suite named "name", else "name[param]" (or all of them if name is NULL) */
+static struct test_t *register_static(struct testfw_t *fw, char *suite, char *name, int *k)
+{
+    int first = -1; /* index of the first test, as tests may be reallocated */
+    for (int pass = 0; pass < 2 && first < 0; pass++)
+        for (int i = 0; i < nstatic_tests; i++)
+        {
+            struct static_test_t *s = &static_tests[i];
+            if (strcmp(s->suite, suite) != 0)
+                continue;
+            size_t len = name ? strlen(name) : 0;
+            if (name && (strncmp(s->name, name, len) != 0 || s->name[len] != (pass == 0 ? 0 : '[')))
+                continue;
+            add_test(fw, suite, s->name, s->func);
+            if (first < 0)
+                first = fw->size - 1;
+            (*k)++;
+            if (name && pass == 0)
+                break; /* exact name */
+        }
+    return (first >= 0) ? &fw->tests[first] : NULL;
+}
+
+struct test_t *testfw_register_symb(struct testfw_t *fw, char *suite, char *name)
+{
+    assert(fw);
     assert(suite && name);
-    void *handle = dlopen(NULL, RTLD_LAZY); /* if NULL, then the returned handle is for the main program */
-    assert(handle);
+    struct timespec ts_register;
+    trace_begin(fw, &ts_register);
+    struct library_t *lib = find_library(fw, &suite);
+    int k = 0;
+    int first = -1; /* index of the first test, as tests may be reallocated */
     char *funcname = test2func(suite, name);
-    testfw_func_t func = lookup_symb(handle, funcname);
-    struct test_t *t = add_test(fw, suite, name, func);
+    /* an unqualified test is registered from the program and all test libraries (as testfw_register_suite()) */
+    if (!lib)
+    {
+        if (register_static(fw, suite, name, &k))
+            first = fw->size - k;
+        void *handle = dlopen(NULL, RTLD_LAZY); /* if NULL, then the returned handle is for the main program */
+        assert(handle);
+        testfw_func_t func = (testfw_func_t)dlsym(handle, funcname);
+        if (func && k == 0)
+        {
+            add_test(fw, suite, name, func);
+            first = fw->size - 1;
+        }
+        dlclose(handle);
+    }
+    for (int i = 0; i < fw->nlibs; i++)
+    {
+        if (lib && lib != &fw->libs[i])
+            continue;
+        testfw_func_t func = lib ? lookup_symb(lib->handle, funcname) : (testfw_func_t)dlsym(fw->libs[i].handle, funcname);
+        if (!func)
+            continue;
+        char *qualified = NULL;
+        asprintf(&qualified, "%s:%s", fw->libs[i].name, suite);
+        assert(qualified);
+        add_test(fw, qualified, name, func);
+        free(qualified);
+        if (first < 0)
+            first = fw->size - 1;
+    }
+    if (first < 0)
+    {
+        fprintf(stderr, "Error: symbol \"%s\" not found!\n", funcname);
+        exit(EXIT_FAILURE);
+    }
     free(funcname);
-    dlclose(handle);
-    return t;
+    trace_end(fw, &ts_register, "framework", "register", NULL);
+    return &fw->tests[first];
+}
+
+/* ********** DISCOVER TESTS ********** */
+
+/* read the GNU build-id note of an ELF file as an hexadecimal string, else "" */
+static void read_buildid(char *filename, char *buildid, size_t size)
+{
+    assert(buildid && size > 0);
+    *buildid = 0;
+#if defined(__linux__)
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ElfW(Ehdr)))
+    {
+        close(fd);
+        return;
+    }
+    unsigned char *elf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (elf == MAP_FAILED)
+        return;
+    ElfW(Ehdr) *ehdr = (ElfW(Ehdr) *)elf;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) == 0 && ehdr->e_shoff + ehdr->e_shnum * sizeof(ElfW(Shdr)) <= (size_t)st.st_size)
+    {
+        ElfW(Shdr) *shdr = (ElfW(Shdr) *)(elf + ehdr->e_shoff);
+        for (int i = 0; i < ehdr->e_shnum && *buildid == 0; i++)
+        {
+            if (shdr[i].sh_type != SHT_NOTE || shdr[i].sh_offset + shdr[i].sh_size > (size_t)st.st_size)
+                continue;
+            size_t off = 0;
+            while (off + sizeof(ElfW(Nhdr)) <= shdr[i].sh_size)
+            {
+                ElfW(Nhdr) *nhdr = (ElfW(Nhdr) *)(elf + shdr[i].sh_offset + off);
+                size_t namesz = (nhdr->n_namesz + 3) & ~3UL;
+                size_t descsz = (nhdr->n_descsz + 3) & ~3UL;
+                unsigned char *desc = (unsigned char *)(nhdr + 1) + namesz;
+                if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && memcmp(nhdr + 1, "GNU", 4) == 0)
+                {
+                    for (size_t k = 0; k < nhdr->n_descsz && 2 * k + 2 < size; k++)
+                        sprintf(buildid + 2 * k, "%02x", desc[k]);
+                    break;
+                }
+                off += sizeof(ElfW(Nhdr)) + namesz + descsz;
+            }
+        }
+    }
+    munmap(elf, st.st_size);
+#endif
+}
+
+/* the cache key identifies a given build of the program (mtime, size & build-id) */
+static char *cache_key(char *filename)
+{
+    struct stat st;
+    if (stat(filename, &st) < 0)
+        return NULL;
+    char buildid[128];
+    read_buildid(filename, buildid, sizeof(buildid));
+    char *key = NULL;
+    asprintf(&key, "testfw-cache %ld.%09ld %ld %s\n", (long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec, (long)st.st_size, *buildid ? buildid : "-");
+    assert(key);
+    return key;
+}
+
+static void append_symbol(char ***symbols, int *nsymbols, int *maxsymbols, char *name)
+{
+    if (*nsymbols == *maxsymbols)
+    {
+        *maxsymbols *= 2;
+        *symbols = realloc(*symbols, (*maxsymbols + 1) * sizeof(char *));
+        assert(*symbols);
+    }
+    (*symbols)[*nsymbols] = strdup(name);
+    (*symbols)[*nsymbols + 1] = NULL;
+    (*nsymbols)++;
+}
+
+/* discovery of all symbols defined in a file (program or library), either from its cache file or using nm */
+struct discovery_t
+{
+    char *filename;
+    char *key;       /* cache key, else NULL */
+    char *cachefile; /* cache file "<filename>.testfw-cache", else NULL */
+    FILE *stream;    /* output of nm, else NULL if cached */
+    char **symbols;
+    int nsymbols;
+    int maxsymbols;
+};
+
+/* the discovery cache is also kept in memory, so that processes forked later (e.g. by a daemon) reuse it */
+struct memo_t
+{
+    char *key;      /* cache key */
+    char **symbols; /* symbols (NULL terminated) */
+};
+
+static struct memo_t *memos = NULL;
+static int nmemos = 0;
+
+static bool memo_load(struct discovery_t *d)
+{
+    for (int i = 0; i < nmemos; i++)
+        if (strcmp(memos[i].key, d->key) == 0)
+        {
+            for (char **s = memos[i].symbols; *s; s++)
+                append_symbol(&d->symbols, &d->nsymbols, &d->maxsymbols, *s);
+            return true;
+        }
+    return false;
+}
+
+static void memo_save(struct discovery_t *d)
+{
+    int nsymbols = 0, maxsymbols = d->nsymbols;
+    char **symbols = malloc((maxsymbols + 1) * sizeof(char *));
+    memos = realloc(memos, (nmemos + 1) * sizeof(struct memo_t));
+    assert(symbols && memos);
+    symbols[0] = NULL;
+    for (char **s = d->symbols; *s; s++)
+        append_symbol(&symbols, &nsymbols, &maxsymbols, *s);
+    memos[nmemos].key = strdup(d->key);
+    memos[nmemos++].symbols = symbols;
+}
+
+/* start a discovery: load symbols from the cache (in memory or file) if up to date, else launch nm in background */
+static bool discovery_start(struct testfw_t *fw, struct discovery_t *d, char *filename)
+{
+    assert(fw && d && filename);
+    d->filename = filename;
+    d->nsymbols = 0;
+    d->maxsymbols = 64;
+    d->symbols = malloc((d->maxsymbols + 1) * sizeof(char *));
+    assert(d->symbols);
+    d->symbols[0] = NULL;
+    d->stream = NULL;
+    d->key = fw->cache ? cache_key(filename) : NULL;
+    d->cachefile = NULL;
+    if (d->key)
+        asprintf(&d->cachefile, "%s.testfw-cache", filename);
+    if (d->key && memo_load(d))
+        return true;
+
+    char *line = NULL;
+    size_t size = 0;
+
+    /* fast path: the file has not changed since the last discovery */
+    FILE *cache = d->cachefile ? fopen(d->cachefile, "r") : NULL;
+    if (cache)
+    {
+        if (getline(&line, &size, cache) > 0 && strcmp(line, d->key) == 0)
+        {
+            while (getline(&line, &size, cache) > 0)
+            {
+                line[strcspn(line, "\n")] = 0;
+                append_symbol(&d->symbols, &d->nsymbols, &d->maxsymbols, line);
+            }
+            fclose(cache);
+            free(line);
+            memo_save(d);
+            return true;
+        }
+        fclose(cache);
+    }
+    free(line);
+
+    /* TODO: inspect symbol table instead of using nm external command */
+    char *cmdline = malloc(strlen("nm --defined-only ''") + 4 * strlen(filename) + 1);
+    assert(cmdline);
+    char *c = cmdline + sprintf(cmdline, "nm --defined-only '");
+    for (char *f = filename; *f; f++)
+        c += (*f == '\'') ? sprintf(c, "'\\''") : sprintf(c, "%c", *f); /* quoted for the shell */
+    strcpy(c, "'");
+    d->stream = popen(cmdline, "r"); /* nm sorts all symbols before printing, so it runs concurrently */
+    assert(d->stream);
+    free(cmdline);
+    return false;
+}
+
+/* end a discovery: read the output of nm and save the cache file, then return all symbols */
+static char **discovery_end(struct discovery_t *d)
+{
+    assert(d);
+    if (d->stream)
+    {
+        char *line = NULL;
+        size_t size = 0;
+        while (getline(&line, &size, d->stream) > 0)
+        {
+            line[strcspn(line, "\n")] = 0;
+            char *name = strrchr(line, ' '); /* "address type name" */
+            if (name)
+                append_symbol(&d->symbols, &d->nsymbols, &d->maxsymbols, name + 1);
+        }
+        pclose(d->stream);
+        free(line);
+
+        /* save cache file atomically */
+        if (d->cachefile)
+        {
+            memo_save(d);
+            char *tmpfile = NULL;
+            asprintf(&tmpfile, "%s.%d", d->cachefile, getpid());
+            assert(tmpfile);
+            FILE *out = fopen(tmpfile, "w");
+            if (out)
+            {
+                fputs(d->key, out);
+                for (char **s = d->symbols; *s; s++)
+                    fprintf(out, "%s\n", *s);
+                if (fclose(out) == 0)
+                    rename(tmpfile, d->cachefile);
+                else
+                    unlink(tmpfile);
+            }
+            free(tmpfile);
+        }
+    }
+    free(d->cachefile);
+    free(d->key);
+    return d->symbols;
 }
 
-static char **discover_all_tests(struct testfw_t *fw, char *suite)
+/* load all symbols defined in the program and in test libraries (if not yet loaded), with concurrent nm processes */
+static void load_symbols(struct testfw_t *fw)
 {
     assert(fw);
-    void *handle = dlopen(NULL, RTLD_LAZY); /* if NULL, then the returned handle is for the main program */
-    assert(handle);
+    char ****symbols = malloc((1 + fw->nlibs) * sizeof(char ***)); /* symbols to load */
+    char **files = malloc((1 + fw->nlibs) * sizeof(char *));
+    assert(symbols && files);
+    int nfiles = 0;
+    if (!fw->symbols)
+    {
+        symbols[nfiles] = &fw->symbols;
+        files[nfiles++] = fw->program;
+    }
+    for (int i = 0; i < fw->nlibs; i++)
+        if (!fw->libs[i].symbols)
+        {
+            symbols[nfiles] = &fw->libs[i].symbols;
+            files[nfiles++] = fw->libs[i].path;
+        }
+    if (nfiles == 0)
+    {
+        free(symbols);
+        free(files);
+        return;
+    }
+
+    struct timespec ts_discover, ts_nm;
+    trace_begin(fw, &ts_discover);
+    trace_begin(fw, &ts_nm);
+    struct discovery_t *d = malloc(nfiles * sizeof(struct discovery_t));
+    assert(d);
+    int ncached = 0;
+    for (int i = 0; i < nfiles; i++)
+        ncached += discovery_start(fw, &d[i], files[i]);
+    for (int i = 0; i < nfiles; i++)
+        *symbols[i] = discovery_end(&d[i]);
+    free(d);
+    free(symbols);
+    free(files);
+    char args[64];
+    if (ncached < nfiles)
+    {
+        snprintf(args, sizeof(args), "{\"files\":%d}", nfiles - ncached);
+        trace_end(fw, &ts_nm, "command", "nm", args);
+    }
+    snprintf(args, sizeof(args), "{\"cached\":%s,\"files\":%d}", (ncached == nfiles) ? "true" : "false", nfiles);
+    trace_end(fw, &ts_discover, "framework", "discover", args);
+}
+
+static char **discover_all_tests(char **symbols, char *suite)
+{
+    assert(symbols);
     int nbtests = 0;
     int maxtests = 10;
     char **names = malloc((maxtests + 1) * sizeof(char *));
     assert(names);
     names[0] = NULL;
 
-    char *cmdline = NULL;
-
-    char *prefix_ = malloc(strlen(suite) + 2); /* adding a trailing '_' to suite */
+    char *prefix_ = malloc(strlen(suite) + 3); /* adding a trailing '_' to suite */
     assert(prefix_);
 #if defined(__APPLE__) && defined(__MACH__)
     strcpy(prefix_, "_");
@@ -171,44 +1480,25 @@ static char **discover_all_tests(struct testfw_t *fw, char *suite)
     strcat(prefix_, "_");
 #endif
 
-    /* TODO: inspect symbol table instead of using nm external command */
-    asprintf(&cmdline, "nm --defined-only %s | cut -d ' ' -f 3 | grep ^%s ", fw->program, prefix_);
-    // printf("cmdline: %s\n", cmdline);
-    assert(cmdline);
-    FILE *stream = popen(cmdline, "r");
-    char *funcname = NULL;
-    size_t size = 0;
-    while (getline(&funcname, &size, stream) > 0)
+    for (char **s = symbols; *s; s++)
     {
-        if (nbtests == maxtests)
-        {
-            maxtests *= 2;
-            names = realloc(names, (maxtests + 1) * sizeof(char *));
-            assert(names);
-        }
-        funcname[strlen(funcname) - 1] = 0; /* remove trailing \n */
-        char *name = strstr(funcname, prefix_);
-        assert(name);
-        name += strlen(prefix_);
+        if (strncmp(*s, prefix_, strlen(prefix_)) != 0)
+            continue;
+        char *name = *s + strlen(prefix_);
         // printf("discover test: %s\n", name);
-        names[nbtests] = strdup(name);
-        names[nbtests + 1] = NULL;
-        nbtests++;
+        append_symbol(&names, &nbtests, &maxtests, name);
     }
-    free(funcname);
-    free(cmdline);
-    pclose(stream);
-    dlclose(handle);
+    free(prefix_);
     return names;
 }
 
-int testfw_register_suite(struct testfw_t *fw, char *suite)
+static int register_tests(struct testfw_t *fw, char *suite, char **symbols, void *handle, struct library_t *lib)
 {
-    assert(fw);
-    assert(suite);
-    char **names = discover_all_tests(fw, suite);
-    void *handle = dlopen(NULL, RTLD_LAZY); /* if NULL, then the returned handle is for the main program */
-    assert(handle);
+    char **names = discover_all_tests(symbols, suite);
+    char *qualified = suite;
+    if (lib)
+        asprintf(&qualified, "%s:%s", lib->name, suite);
+    assert(qualified);
     char **t = names;
     int k = 0;
     while (*t)
@@ -216,43 +1506,106 @@ int testfw_register_suite(struct testfw_t *fw, char *suite)
         char *name = *t;
         char *funcname = test2func(suite, name);
         testfw_func_t func = lookup_symb(handle, funcname);
-        add_test(fw, suite, name, func);
+        add_test(fw, qualified, name, func);
         free(name);
         free(funcname);
         t++;
         k++;
     }
-    dlclose(handle);
+    if (lib)
+        free(qualified);
     free(names);
     return k;
 }
 
+int testfw_register_suite(struct testfw_t *fw, char *suite)
+{
+    assert(fw);
+    assert(suite);
+    load_symbols(fw);
+    struct timespec ts_register;
+    trace_begin(fw, &ts_register);
+    struct library_t *lib = find_library(fw, &suite);
+    int k = 0;
+    /* an unqualified suite is registered from the program and all test libraries */
+    if (!lib)
+    {
+        void *handle = dlopen(NULL, RTLD_LAZY); /* if NULL, then the returned handle is for the main program */
+        assert(handle);
+        k += register_tests(fw, suite, fw->symbols, handle, NULL);
+        dlclose(handle);
+        register_static(fw, suite, NULL, &k);
+    }
+    for (int i = 0; i < fw->nlibs; i++)
+        if (!lib || lib == &fw->libs[i])
+            k += register_tests(fw, suite, fw->libs[i].symbols, fw->libs[i].handle, &fw->libs[i]);
+    trace_end(fw, &ts_register, "framework", "register", NULL);
+    return k;
+}
+
 /* ********** DIAGNOSTIC ********** */
 
-static void print_diag_test(FILE *stream, struct test_t *t, int wstatus, double mtime)
+static void print_diag_test(FILE *stream, struct test_t *t, char *param, int wstatus, double mtime, char *tag, char *info)
 {
     assert(stream);
     assert(t);
 
+    /* sub-results (e.g. data rows) are named "suite.name[param]" */
+    char *open = param ? "[" : "";
+    char *close = param ? "]" : "";
+    if (!param)
+        param = "";
+    /* additional information, such as the baseline comparison */
+    if (!info)
+        info = "";
+    /* a successful test may still fail a threshold, that tags it (e.g. "SLOWER") */
+
     if (WIFEXITED(wstatus))
     {
         int status = WEXITSTATUS(wstatus);
-        if (status == TESTFW_EXIT_SUCCESS)
-            fprintf(stream, "%s[SUCCESS]%s run test \"%s.%s\" in %.2f ms (status %d)\n", GREEN, NC, t->suite, t->name, mtime, status);
+        if (status == TESTFW_EXIT_SUCCESS && tag)
+            fprintf(stream, "%s[%s]%s run test \"%s.%s%s%s%s\" in %.2f ms (status %d%s)\n", RED, tag, NC, t->suite, t->name, open, param, close, mtime, status, info);
+        else if (status == TESTFW_EXIT_SUCCESS)
+            fprintf(stream, "%s[SUCCESS]%s run test \"%s.%s%s%s%s\" in %.2f ms (status %d%s)\n", GREEN, NC, t->suite, t->name, open, param, close, mtime, status, info);
         else if (status == TESTFW_EXIT_TIMEOUT)
-            fprintf(stream, "%s[TIMEOUT]%s run test \"%s.%s\" in %.2f ms (status %d)\n", RED, NC, t->suite, t->name, mtime, status);
+            fprintf(stream, "%s[TIMEOUT]%s run test \"%s.%s%s%s%s\" in %.2f ms (status %d%s)\n", RED, NC, t->suite, t->name, open, param, close, mtime, status, info);
         else
-            fprintf(stream, "%s[FAILURE]%s run test \"%s.%s\" in %.2f ms (status %d)\n", RED, NC, t->suite, t->name, mtime, status);
+            fprintf(stream, "%s[FAILURE]%s run test \"%s.%s%s%s%s\" in %.2f ms (status %d%s)\n", RED, NC, t->suite, t->name, open, param, close, mtime, status, info);
     }
     else if (WIFSIGNALED(wstatus))
     {
         int sig = WTERMSIG(wstatus);
-        fprintf(stream, "%s[KILLED]%s run test \"%s.%s\" in %.2f ms (signal \"%s\")\n", RED, NC, t->suite, t->name, mtime, strsignal(sig));
+        fprintf(stream, "%s[KILLED]%s run test \"%s.%s%s%s%s\" in %.2f ms (signal \"%s\"%s)\n", RED, NC, t->suite, t->name, open, param, close, mtime, strsignal(sig), info);
     }
     else
         assert(0); // you should not be here?
 }
 
+/* trace a test span named "suite.name", with its status and counters as args */
+static void trace_test(struct testfw_t *fw, struct timespec *ts_start, struct test_t *t, struct testfw_result_t *res)
+{
+    if (fw->tracefd < 0)
+        return;
+    char name[256];
+    char counters[448];
+    char args[512];
+    snprintf(name, sizeof(name), "%s.%s", t->suite, t->name);
+    format_counters(res->counters, counters, sizeof(counters), true);
+    if (res->memory >= 0)
+        snprintf(counters + strlen(counters), sizeof(counters) - strlen(counters), ",\"memory\":%lld", res->memory);
+    if (res->cpu >= 0)
+        snprintf(counters + strlen(counters), sizeof(counters) - strlen(counters), ",\"cpu_us\":%lld", res->cpu);
+    if (res->allocs >= 0)
+        snprintf(counters + strlen(counters), sizeof(counters) - strlen(counters),
+                 ",\"allocs\":%lld,\"allocated\":%lld,\"peak\":%lld,\"leaked\":%lld", res->allocs, res->allocated,
+                 res->peak, res->leaked);
+    if (WIFSIGNALED(res->wstatus))
+        snprintf(args, sizeof(args), "{\"signal\":%d%s}", WTERMSIG(res->wstatus), counters);
+    else
+        snprintf(args, sizeof(args), "{\"status\":%d%s}", WEXITSTATUS(res->wstatus), counters);
+    trace_end(fw, ts_start, "test", name, args);
+}
+
 /* ********** RUN TEST (FORK MODE) ********** */
 
 sigjmp_buf alarm_env;
@@ -263,7 +1616,7 @@ static void alarm_handler(int s)
     siglongjmp(alarm_env, 1);
 }
 
-static int run_test_forks(struct testfw_t *fw, struct test_t *t, int argc, char *argv[])
+static void run_test_forks(struct testfw_t *fw, struct test_t *t, int argc, char *argv[], struct testfw_result_t *res)
 {
     assert(fw);
     assert(t);
@@ -271,6 +1624,8 @@ static int run_test_forks(struct testfw_t *fw, struct test_t *t, int argc, char
 
     int fd = -1;
     FILE *stream = NULL;
+    struct timespec ts_test, ts_span;
+    trace_begin(fw, &ts_test);
 
     /* open log file */
     if (fw->logfile)
@@ -280,13 +1635,15 @@ static int run_test_forks(struct testfw_t *fw, struct test_t *t, int argc, char
     /* pipe to an external command */
     else if (fw->cmd)
     {
+        trace_begin(fw, &ts_span);
         stream = popen(fw->cmd, "w"); // fork exec pipe
         assert(stream);
         fd = fileno(stream);
+        trace_end(fw, &ts_span, "command", "popen", NULL);
     }
 
-    struct timeval tv_start, tv_end;
-    gettimeofday(&tv_start, NULL);
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
 
     sigset_t sigset;
     sigemptyset(&sigset);
@@ -295,12 +1652,29 @@ static int run_test_forks(struct testfw_t *fw, struct test_t *t, int argc, char
         sigaddset(&sigset, SIGALRM);
         sigprocmask(SIG_BLOCK, &sigset, NULL);
     }
+    /* the child waits for its counters to be opened and to be moved in its cgroup */
+    bool wait_go = fw->counters || fw->isolate;
+    int gofd[2] = {-1, -1};
+    if (wait_go && pipe(gofd) == -1)
+    {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+
     /* run test */
+    fflush(stdout); // else buffered diagnostics are duplicated in child
+    fflush(stderr);
+    struct alloc_slot_t *slot = fw->allocslots ? &fw->allocslots[t - fw->tests] : NULL;
+    trace_begin(fw, &ts_span);
     pid_t pid = fork();
     // setpgid(0, 0); // set the PGID of a process to its own PID
 
     if (pid == 0)
     {
+        if (fw->resultfd >= 0)
+            close(fw->resultfd);
+        if (fw->reportfd >= 0)
+            close(fw->reportfd);
         if (fw->logfile || fw->cmd)
         {
             dup2(fd, STDOUT_FILENO);
@@ -310,14 +1684,58 @@ static int run_test_forks(struct testfw_t *fw, struct test_t *t, int argc, char
         }
         fflush(stdout);
         fflush(stderr);
+        bench_output(fw);
+        pin_cpu(fw, (fw->cpuslot >= 0) ? fw->cpuslot : t - fw->tests); // on the CPU of its worker, if any
 
+        signal(SIGALRM, SIG_DFL); // the alarm handler of the framework must not be inherited by tests
         if (fw->timeout > 0)
             sigprocmask(SIG_UNBLOCK, &sigset, NULL); // unblock SIGALRM
 
+        if (fw->isolate)
+        {
+            setpgid(0, 0);                   // also set by the framework, whichever runs first
+            prctl(PR_SET_PDEATHSIG, SIGKILL); // do not survive the framework
+        }
+        if (wait_go)
+        {
+            char go;
+            close(gofd[1]);
+            testfw_read_full(gofd[0], &go, 1);
+            close(gofd[0]);
+        }
+
         /* execution */
+        trace_begin(fw, &ts_span);
+        alloc_start(slot);
         int status = t->func(argc, argv);
+        alloc_stop(slot);
+        trace_end(fw, &ts_span, "test", "exec", NULL);
         exit(status);
     }
+    trace_end(fw, &ts_span, "framework", "fork", NULL);
+
+    char *cgroup = NULL;
+    if (fw->isolate)
+    {
+        setpgid(pid, pid);
+        cgroup = cgroup_create(fw);
+        char value[32];
+        snprintf(value, sizeof(value), "%d", pid);
+        if (cgroup && !cgroup_write(cgroup, "cgroup.procs", value))
+        {
+            fprintf(stderr, "Error: cannot move test in cgroup \"%s\"!\n", cgroup);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int counterfds[TESTFW_NCOUNTERS];
+    open_counters(fw, pid, counterfds);
+    if (wait_go)
+    {
+        close(gofd[0]);
+        testfw_write_full(gofd[1], "", 1);
+        close(gofd[1]);
+    }
+    trace_begin(fw, &ts_span);
 
     /* timeout management */
     if (fw->timeout > 0)
@@ -333,106 +1751,157 @@ static int run_test_forks(struct testfw_t *fw, struct test_t *t, int argc, char
 
     if (sigsetjmp(alarm_env, 1) == 0)
     {
-        int r = waitpid(pid, &wstatus, 0); // may be interrupted by timeout
-        assert(r == pid);
+        siginfo_t info;
+        int r = waitid(P_PID, pid, &info, WEXITED | WNOWAIT); // not reaped yet, may be interrupted by timeout
+        assert(r == 0);
         alarm(0); // cancel pending alarm if any!
+        if (fw->isolate)
+            kill_test(cgroup, pid); // processes left behind by the test
+        r = waitpid(pid, &wstatus, 0);
+        assert(r == pid);
     }
     else
     {
         // printf("timeout: sigalarm interrupt waitpid()!\n");
-        kill(pid, SIGKILL);
-        int r = waitpid(pid, &wstatus, 0); // may be interrupted by timeout
+        if (fw->isolate)
+            kill_test(cgroup, pid); // the whole process tree
+        else
+            kill(pid, SIGKILL);
+        int r = waitpid(pid, &wstatus, 0);
         assert(r == pid);
-        assert(WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGKILL);
         int status = TESTFW_EXIT_TIMEOUT;
-        wstatus = (status << 8) & 0xFF00; // TODO: use __W_EXITCODE() instead? is this portable?
+        if (WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGKILL) // else the test was over just before the timeout
+            wstatus = (status << 8) & 0xFF00; // TODO: use __W_EXITCODE() instead? is this portable?
     }
 
-    gettimeofday(&tv_end, NULL);
-    double mtime = (tv_end.tv_sec - tv_start.tv_sec) * 1000.0 + (tv_end.tv_usec - tv_start.tv_usec) / 1000.0; // in ms
+    double mtime = mtime_since(&ts_start);
+    trace_end(fw, &ts_span, "framework", "wait", NULL);
 
     if (fw->logfile)
         close(fd);
     else if (fw->cmd)
     {
+        trace_begin(fw, &ts_span);
         int pwstatus = pclose(stream);
+        trace_end(fw, &ts_span, "command", "pclose", NULL);
         // printf("pclose return %d\n", WEXITSTATUS(pwstatus));
         if (wstatus == 0)
             wstatus = pwstatus;
     }
-
-    if (!fw->silent)
-        print_diag_test(stdout, t, wstatus, mtime);
-
-    return (WIFEXITED(wstatus) && !WEXITSTATUS(wstatus)) ? 0 : 1; // if failure, return 1, else 0
+    res->index = t - fw->tests;
+    res->wstatus = wstatus;
+    res->mtime = mtime;
+    close_counters(counterfds, res->counters);
+    cgroup_remove(cgroup, res);
+    alloc_result(slot, res);
+    trace_test(fw, &ts_test, t, res);
 }
 
 /* ********** RUN TEST (PARALLEL FORK MODE) ********** */
 
-static int run_test_forkp(struct testfw_t *fw, struct test_t *t, int argc, char *argv[])
+/* start a worker on a CPU slot, that runs all repetitions of a test and sends their results through the result pipe */
+static pid_t run_test_forkp(struct testfw_t *fw, struct test_t *t, int argc, char *argv[], int slot)
 {
-    if (fork() == 0)
+    trace_lane(fw, 1 + (t - fw->tests));
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0)
     {
-        int r = run_test_forks(fw, t, argc, argv);
-        exit(r); // 0 ou 1
+        fw->tracelane = 1 + (t - fw->tests);
+        fw->cpuslot = slot;
+        pin_cpu(fw, slot); // each running worker has its own CPU
+        for (int r = 0; r < fw->repeat; r++)
+        {
+            struct testfw_result_t res;
+            run_test_forks(fw, t, argc, argv, &res);
+            ssize_t w = write(fw->resultfd, &res, sizeof(res)); // atomic (less than PIPE_BUF)
+            assert(w == sizeof(res));
+        }
+        exit(EXIT_SUCCESS);
     }
-    return EXIT_SUCCESS;
+    return pid;
 }
 
 /* ********** RUN TEST (NOFORK MODE) ********** */
 
-static int run_test_nofork(struct testfw_t *fw, struct test_t *t, int argc, char *argv[])
+/* redirect the standard outputs of the framework process to the log file (if any) while it runs a test */
+static void log_redirect(struct testfw_t *fw, int saved[2])
+{
+    saved[0] = saved[1] = -1;
+    if (!fw->logfile)
+        return;
+    fflush(stdout);
+    fflush(stderr);
+    int fd = open(fw->logfile, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        return;
+    saved[0] = dup(1);
+    saved[1] = dup(2);
+    dup2(fd, 1);
+    dup2(fd, 2);
+    close(fd);
+}
+
+/* restore the standard outputs of the framework process */
+static void log_restore(int saved[2])
+{
+    if (saved[0] < 0)
+        return;
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved[0], 1);
+    dup2(saved[1], 2);
+    close(saved[0]);
+    close(saved[1]);
+}
+
+static void run_test_nofork(struct testfw_t *fw, struct test_t *t, int argc, char *argv[], struct testfw_result_t *res)
 {
     assert(t);
     int wstatus = 0;
 
     /* open log file */
-    int fd = -1;
-    int fdout = -1;
-    int fderr = -1;
-    if (fw->logfile)
-    {
-        fd = open(fw->logfile, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        fdout = dup(1);
-        fderr = dup(2);
-        dup2(fd, 1);
-        dup2(fd, 2);
-        close(fd);
-    }
+    int saved[2];
+    log_redirect(fw, saved);
 
     if (fw->timeout > 0)
         alarm(fw->timeout); // TODO: should be catch to return status 124
 
-    struct timeval tv_start, tv_end;
-    gettimeofday(&tv_start, NULL);
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
     fflush(stdout);
     fflush(stderr);
 
+    int counterfds[TESTFW_NCOUNTERS];
+    open_counters(fw, 0, counterfds); // the framework itself
+    struct alloc_slot_t *slot = fw->allocslots ? &fw->allocslots[t - fw->tests] : NULL;
+    alloc_start(slot);
     int status = t->func(argc, argv);
+    alloc_stop(slot);
     wstatus = (status << 8) & 0xFF00; // TODO: is this portable?
 
-    gettimeofday(&tv_end, NULL);
-    double mtime = (tv_end.tv_sec - tv_start.tv_sec) * 1000.0 + (tv_end.tv_usec - tv_start.tv_usec) / 1000.0; // in ms
+    double mtime = mtime_since(&ts_start);
 
     /* cancel alarm */
     if (fw->timeout > 0)
         alarm(0);
 
     /* restore standard out & err */
-    if (fw->logfile)
-    {
-        dup2(fdout, 1);
-        dup2(fderr, 2);
-    }
-    if (!fw->silent)
-        print_diag_test(stdout, t, wstatus, mtime);
-
-    return (status == 0) ? 0 : 1;
+    log_restore(saved);
+    res->index = t - fw->tests;
+    res->wstatus = wstatus;
+    res->mtime = mtime;
+    close_counters(counterfds, res->counters);
+    res->memory = -1;
+    res->cpu = -1;
+    alloc_result(slot, res);
+    trace_test(fw, &ts_start, t, res);
 }
 
 /* ********** RUN TEST  ********** */
 
-static int run_test(struct testfw_t *fw, struct test_t *t, int argc, char *argv[], enum testfw_mode_t mode)
+static void run_test(struct testfw_t *fw, struct test_t *t, int argc, char *argv[], enum testfw_mode_t mode, struct testfw_result_t *res)
 {
     if (!fw->silent && fw->verbose)
         printf("******************** RUN TEST \"%s.%s\" ********************\n", t->suite, t->name);
@@ -440,46 +1909,1625 @@ static int run_test(struct testfw_t *fw, struct test_t *t, int argc, char *argv[
     switch (mode)
     {
     case TESTFW_FORKS:
-        return run_test_forks(fw, t, argc, argv);
-    case TESTFW_FORKP:
-        return run_test_forkp(fw, t, argc, argv);
+        run_test_forks(fw, t, argc, argv, res);
+        break;
     case TESTFW_NOFORK:
-        return run_test_nofork(fw, t, argc, argv);
+        run_test_nofork(fw, t, argc, argv, res);
+        break;
     default:
         fprintf(stderr, "Error: invalid execution mode (%d)!\n", mode);
         exit(EXIT_FAILURE);
     }
+}
+
+/* ********** PERFORMANCE BASELINE ********** */
+
+/**
+ * A baseline file stores the durations measured for each test (in ms), one test per line:
+ * "suite.name duration1 duration2 ...". A test is SLOWER than its baseline if the ratio of median durations is
+ * greater than the threshold and if a one-sided Mann-Whitney U test (rank-based, thus robust to outliers) rejects the
+ * hypothesis that durations are not greater than the baseline ones, at the significance level alpha.
+ */
+
+struct samples_t
+{
+    char *name;      /* "suite.name" */
+    int n;           /* number of samples */
+    double *samples; /* durations (in ms) */
+    int wstatus;     /* first failure status, else success */
+    long long counters[TESTFW_NCOUNTERS]; /* sum of counters over runs, else -1 if not available */
+    long long memory;                     /* maximal peak memory usage over runs (in bytes), else -1 */
+    long long cpu;                        /* sum of CPU usage over runs (in us), else -1 */
+    long long allocs;                     /* maximal number of allocations over runs, else -1 */
+    long long allocated;                  /* maximal bytes allocated over runs, else -1 */
+    long long peak;                       /* maximal peak of live bytes over runs, else -1 */
+    long long leaked;                     /* maximal bytes leaked over runs, else -1 */
+};
 
-    return EXIT_FAILURE;
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
 }
 
-static int wait_all_tests_forkp(struct testfw_t *fw)
+static double median(double *samples, int n)
 {
-    assert(fw);
-    int nfailures = 0;
-    for (int i = 0; i < fw->size; i++)
+    assert(n > 0);
+    double *sorted = malloc(n * sizeof(double));
+    assert(sorted);
+    memcpy(sorted, samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+    double m = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+    free(sorted);
+    return m;
+}
+
+/* p-value of the one-sided Mann-Whitney U test "x greater than y" (normal approximation with continuity correction) */
+static double mann_whitney(double *x, int n, double *y, int m)
+{
+    double u = 0.0;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            u += (x[i] > y[j]) ? 1.0 : (x[i] == y[j]) ? 0.5 : 0.0;
+    double mu = n * m / 2.0;
+    double sigma = sqrt(n * m * (n + m + 1) / 12.0);
+    double z = (u - mu - 0.5) / sigma;
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+static struct samples_t *load_baseline(char *filename, int *n)
+{
+    *n = 0;
+    FILE *stream = fopen(filename, "r");
+    if (!stream)
+        return NULL;
+    int max = 10;
+    struct samples_t *entries = malloc(max * sizeof(struct samples_t));
+    assert(entries);
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, stream) > 0)
     {
-        int wstatus = 0;
-        int r = wait(&wstatus);
-        assert(r > 0);
-        nfailures += ((WIFEXITED(wstatus) && !WEXITSTATUS(wstatus)) ? 0 : 1);
+        char *name = strtok(line, " \t\n");
+        if (!name || *name == '#')
+            continue;
+        if (*n == max)
+        {
+            max *= 2;
+            entries = realloc(entries, max * sizeof(struct samples_t));
+            assert(entries);
+        }
+        struct samples_t *e = &entries[*n];
+        e->name = strdup(name);
+        e->n = 0;
+        e->samples = NULL;
+        e->wstatus = 0;
+        for (char *tok = strtok(NULL, " \t\n"); tok; tok = strtok(NULL, " \t\n"))
+        {
+            e->samples = realloc(e->samples, (e->n + 1) * sizeof(double));
+            assert(e->samples);
+            e->samples[e->n++] = atof(tok);
+        }
+        if (e->n > 0)
+            (*n)++;
+        else
+            free(e->name);
     }
-    return nfailures;
+    free(line);
+    fclose(stream);
+    return entries;
 }
 
-int testfw_run_all(struct testfw_t *fw, int argc, char *argv[], enum testfw_mode_t mode)
+static void free_baseline(struct samples_t *entries, int n)
 {
-    assert(fw);
-    int nfailures = 0;
-    for (int i = 0; i < fw->size; i++)
+    for (int i = 0; i < n; i++)
     {
-        struct test_t *t = &fw->tests[i];
-        assert(t);
-        nfailures += run_test(fw, t, argc, argv, mode);
+        free(entries[i].name);
+        free(entries[i].samples);
     }
+    free(entries);
+}
 
-    if (mode == TESTFW_FORKP)
-        nfailures = wait_all_tests_forkp(fw);
+static struct samples_t *find_baseline(struct samples_t *entries, int n, char *name)
+{
+    for (int i = 0; i < n; i++)
+        if (strcmp(entries[i].name, name) == 0)
+            return &entries[i];
+    return NULL;
+}
+
+/* update the saved baseline with the samples of tests that succeed, and keep the other entries */
+static void save_baseline(struct testfw_t *fw, struct samples_t *results)
+{
+    int n = 0;
+    struct samples_t *entries = load_baseline(fw->savebaseline, &n);
+    FILE *stream = fopen(fw->savebaseline, "w");
+    if (!stream)
+    {
+        perror(fw->savebaseline);
+        free_baseline(entries, n);
+        return;
+    }
+    fprintf(stream, "# testfw baseline: suite.name duration1 duration2 ... (in ms)\n");
+    for (int i = 0; i < n; i++)
+    {
+        struct samples_t *r = NULL;
+        for (int k = 0; k < fw->size && !r; k++)
+            if (strcmp(results[k].name, entries[i].name) == 0 && results[k].wstatus == 0 && results[k].n > 0)
+                r = &results[k];
+        if (r)
+            continue; /* replaced below */
+        fprintf(stream, "%s", entries[i].name);
+        for (int j = 0; j < entries[i].n; j++)
+            fprintf(stream, " %.4f", entries[i].samples[j]);
+        fprintf(stream, "\n");
+    }
+    for (int k = 0; k < fw->size; k++)
+    {
+        if (results[k].wstatus != 0 || results[k].n == 0) /* failed or cached */
+            continue;
+        fprintf(stream, "%s", results[k].name);
+        for (int j = 0; j < results[k].n; j++)
+            fprintf(stream, " %.4f", results[k].samples[j]);
+        fprintf(stream, "\n");
+    }
+    fclose(stream);
+    free_baseline(entries, n);
+}
+
+/* report the k-th test once all its repetitions are over, and return 1 if it fails, else 0 */
+static int report_test(struct testfw_t *fw, int k, struct samples_t *results, struct samples_t *baseline, int nbaseline)
+{
+    struct test_t *t = &fw->tests[k];
+    struct samples_t *r = &results[k];
+    double mtime = median(r->samples, r->n);
+    bool slower = false;
+    char info[256] = "";
+    if (fw->repeat > 1)
+        snprintf(info, sizeof(info), ", median of %d runs", r->n);
+
+    struct samples_t *b = find_baseline(baseline, nbaseline, r->name);
+    if (b && r->wstatus == 0)
+    {
+        double ratio = mtime / median(b->samples, b->n);
+        double pvalue = mann_whitney(r->samples, r->n, b->samples, b->n);
+        slower = (ratio > fw->threshold && pvalue < fw->alpha);
+        snprintf(info + strlen(info), sizeof(info) - strlen(info), ", %.2fx baseline, p=%.3f", ratio, pvalue);
+    }
+    char *tag = (r->wstatus == 0) ? alloc_check(fw, r->allocs, r->leaked) : NULL;
+    bool overalloc = (tag != NULL);
+    if (r->allocs >= 0)
+    {
+        char allocated[32], peak[32], leaked[32];
+        format_bytes(r->allocated, allocated, sizeof(allocated));
+        format_bytes(r->peak, peak, sizeof(peak));
+        format_bytes(r->leaked, leaked, sizeof(leaked));
+        snprintf(info + strlen(info), sizeof(info) - strlen(info), ", %lld allocs, %s allocated, peak %s, leaked %s",
+                 r->allocs, allocated, peak, leaked);
+    }
+    if (!tag && slower)
+        tag = "SLOWER";
+
+    struct timespec ts_span;
+    trace_begin(fw, &ts_span);
+    if (!fw->silent)
+        print_diag_test(stdout, t, NULL, r->wstatus, mtime, tag, info);
+    if (!fw->silent && fw->verbose && fw->counters)
+    {
+        long long counters[TESTFW_NCOUNTERS];
+        char buf[256];
+        for (int c = 0; c < TESTFW_NCOUNTERS; c++)
+            counters[c] = (r->counters[c] >= 0) ? r->counters[c] / r->n : -1;
+        format_counters(counters, buf, sizeof(buf), false);
+        printf("    counters: %s%s\n", *buf ? buf : "not available", (r->n > 1) ? " (mean)" : "");
+    }
+    if (!fw->silent && fw->verbose && fw->isolate)
+    {
+        printf("    resources:");
+        if (r->memory >= 0)
+            printf(" peak memory %lld KiB,", r->memory / 1024);
+        if (r->cpu >= 0)
+            printf(" CPU %.2f ms%s,", r->cpu / 1000.0 / r->n, (r->n > 1) ? " (mean)" : "");
+        printf(" %s\n", fw->cgroup ? "cgroup" : "process group");
+    }
+    fflush(stdout);
+    trace_end(fw, &ts_span, "framework", "flush", NULL);
+
+    if (fw->reportfd >= 0)
+    {
+        struct testfw_result_t res;
+        res.index = fw->order ? fw->order[k] : k;
+        res.wstatus = r->wstatus;
+        res.status = WIFEXITED(r->wstatus) ? WEXITSTATUS(r->wstatus) : -1;
+        res.signal = WIFSIGNALED(r->wstatus) ? WTERMSIG(r->wstatus) : 0;
+        res.mtime = mtime;
+        res.slower = slower;
+        res.cached = false;
+        for (int c = 0; c < TESTFW_NCOUNTERS; c++)
+            res.counters[c] = (r->counters[c] >= 0) ? r->counters[c] / r->n : -1;
+        res.memory = r->memory;
+        res.cpu = (r->cpu >= 0) ? r->cpu / r->n : -1;
+        res.allocs = r->allocs;
+        res.allocated = r->allocated;
+        res.peak = r->peak;
+        res.leaked = r->leaked;
+        bool ok = testfw_write_full(fw->reportfd, &res, sizeof(res)); // atomic (less than PIPE_BUF)
+        assert(ok);
+    }
+
+    if (r->wstatus != 0 || overalloc)
+        return 1;
+    return (slower && fw->gate) ? 1 : 0;
+}
+
+/* a result without any measure (e.g. a cached test) */
+static void empty_result(int k, struct testfw_result_t *res)
+{
+    memset(res, 0, sizeof(struct testfw_result_t));
+    res->index = k;
+    for (int c = 0; c < TESTFW_NCOUNTERS; c++)
+        res->counters[c] = -1;
+    res->memory = res->cpu = -1;
+    res->allocs = res->allocated = res->peak = res->leaked = -1;
+}
 
+static void collect_result(struct testfw_t *fw, struct samples_t *results, struct testfw_result_t *res)
+{
+    assert(res->index >= 0 && res->index < fw->size);
+    struct samples_t *r = &results[res->index];
+    for (int k = 0; k < TESTFW_NCOUNTERS; k++)
+    {
+        if (r->n == 0)
+            r->counters[k] = res->counters[k];
+        else if (r->counters[k] >= 0)
+            r->counters[k] = (res->counters[k] >= 0) ? r->counters[k] + res->counters[k] : -1;
+    }
+    if (r->n == 0 || res->memory > r->memory)
+        r->memory = res->memory;
+    if (r->n == 0)
+        r->cpu = res->cpu;
+    else if (r->cpu >= 0)
+        r->cpu = (res->cpu >= 0) ? r->cpu + res->cpu : -1;
+    if (r->n == 0 || res->allocs > r->allocs)
+        r->allocs = res->allocs;
+    if (r->n == 0 || res->allocated > r->allocated)
+        r->allocated = res->allocated;
+    if (r->n == 0 || res->peak > r->peak)
+        r->peak = res->peak;
+    if (r->n == 0 || res->leaked > r->leaked)
+        r->leaked = res->leaked;
+    r->samples[r->n++] = res->mtime;
+    if (r->wstatus == 0)
+        r->wstatus = res->wstatus;
+}
+
+/* ********** FAILED-FIRST STATE ********** */
+
+static bool is_failed(char **failed, struct test_t *t)
+{
+    for (char **f = failed; f && *f; f++)
+    {
+        char *sep = strrchr(*f, '.');
+        if (sep && strncmp(*f, t->suite, sep - *f) == 0 && t->suite[sep - *f] == 0 && strcmp(sep + 1, t->name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* move the tests that failed during the previous run in front of the others (stable) */
+static void load_statefile(struct testfw_t *fw)
+{
+    assert(fw && fw->statefile);
+    free(fw->order);
+    fw->order = NULL;
+    FILE *stream = fopen(fw->statefile, "r");
+    if (!stream)
+        return;
+    int nfailed = 0;
+    int maxfailed = 10;
+    char **failed = malloc((maxfailed + 1) * sizeof(char *));
+    assert(failed);
+    failed[0] = NULL;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, stream) > 0)
+    {
+        line[strcspn(line, "\n")] = 0;
+        append_symbol(&failed, &nfailed, &maxfailed, line);
+    }
+    free(line);
+    fclose(stream);
+
+    /* the previous index of each test is kept, so that the supervisor of an asynchronous run reports it to the host */
+    struct test_t *tests = malloc(fw->capacity * sizeof(struct test_t));
+    int *order = malloc(fw->capacity * sizeof(int));
+    assert(tests && order);
+    int k = 0;
+    for (int pass = 0; pass < 2; pass++)
+        for (int i = 0; i < fw->size; i++)
+            if (is_failed(failed, &fw->tests[i]) == (pass == 0))
+            {
+                order[k] = i;
+                tests[k++] = fw->tests[i];
+            }
+    free(fw->tests);
+    fw->tests = tests;
+    fw->order = order;
+
+    for (char **f = failed; *f; f++)
+        free(*f);
+    free(failed);
+}
+
+static void save_statefile(struct testfw_t *fw, int *failures)
+{
+    assert(fw && fw->statefile);
+    FILE *stream = fopen(fw->statefile, "w");
+    if (!stream)
+    {
+        perror(fw->statefile);
+        return;
+    }
+    for (int i = 0; i < fw->size; i++)
+        if (failures[i])
+            fprintf(stream, "%s.%s\n", fw->tests[i].suite, fw->tests[i].name);
+    fclose(stream);
+}
+
+/* ********** INCREMENTAL RUNS ********** */
+
+/**
+ * The incremental file stores the hash of each test when it last passed, one test per line: "suite.name hash". A test
+ * is cached if its current hash matches. Tests that are not registered keep their entry, and tests that fail (or that
+ * cannot be hashed) lose it.
+ */
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+struct passed_t
+{
+    char *name;    /* "suite.name" */
+    uint64_t hash; /* hash of the test when it passed */
+};
+
+struct incremental_t
+{
+    int npassed;
+    struct passed_t *passed; /* tests that passed, loaded from the incremental file */
+    uint64_t *hashes;        /* hash of each test */
+    bool *hashed;            /* if true, the test has a hash */
+    bool *cached;            /* if true, the test is unchanged since it passed, and is not run */
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *buf, size_t size)
+{
+    const unsigned char *bytes = buf;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    return hash;
+}
+
+/* hash the name and content of a file (a missing file is hashed as such) */
+static uint64_t hash_file(uint64_t hash, char *filename)
+{
+    hash = fnv1a(hash, filename, strlen(filename) + 1);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return fnv1a(hash, "missing", 8);
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        hash = fnv1a(hash, buf, n);
+    close(fd);
+    return hash;
+}
+
+/* hash the name, machine code and arguments of a test, and return false if its function has no dynamic symbol */
+static bool hash_test(struct test_t *t, int argc, char *argv[], uint64_t hash, uint64_t *result)
+{
+#if defined(__linux__)
+    Dl_info info;
+    const ElfW(Sym) *sym = NULL;
+    if (!dladdr1((void *)t->func, &info, (void **)&sym, RTLD_DL_SYMENT) || !sym || info.dli_saddr != (void *)t->func ||
+        sym->st_size == 0) // else the nearest symbol
+        return false;
+    hash = fnv1a(hash, t->suite, strlen(t->suite) + 1);
+    hash = fnv1a(hash, t->name, strlen(t->name) + 1);
+    hash = fnv1a(hash, (void *)t->func, sym->st_size);
+    hash = fnv1a(hash, &argc, sizeof(argc));
+    for (int i = 0; i < argc; i++)
+        hash = fnv1a(hash, argv[i], strlen(argv[i]) + 1);
+    *result = hash;
+    return true;
+#else
+    return false;
+#endif
+}
+
+static struct passed_t *find_passed(struct incremental_t *inc, char *name)
+{
+    for (int i = 0; i < inc->npassed; i++)
+        if (strcmp(inc->passed[i].name, name) == 0)
+            return &inc->passed[i];
+    return NULL;
+}
+
+/* hash the settings that decide whether a test passes, so that cached tests run again when they change */
+static uint64_t hash_settings(struct testfw_t *fw, enum testfw_mode_t mode, uint64_t hash)
+{
+    int flags[] = {mode, fw->timeout, fw->repeat, fw->alloc, fw->fail_on_leak, fw->isolate, fw->gate};
+    long long limits[] = {fw->max_allocs, fw->memory_max};
+    hash = fnv1a(hash, flags, sizeof(flags));
+    hash = fnv1a(hash, limits, sizeof(limits));
+    hash = fnv1a(hash, &fw->cpu_max, sizeof(fw->cpu_max));
+    hash = fnv1a(hash, fw->cmd ? fw->cmd : "", fw->cmd ? strlen(fw->cmd) + 1 : 1);
+    if (fw->gate && fw->baseline)
+    {
+        hash = fnv1a(hash, &fw->threshold, sizeof(fw->threshold));
+        hash = fnv1a(hash, &fw->alpha, sizeof(fw->alpha));
+        hash = hash_file(hash, fw->baseline);
+    }
+    return hash;
+}
+
+/* hash all tests, and find those that are unchanged since they passed */
+static void incremental_start(struct testfw_t *fw, int argc, char *argv[], enum testfw_mode_t mode,
+                              struct incremental_t *inc)
+{
+    inc->npassed = 0;
+    inc->passed = NULL;
+    inc->hashes = calloc(fw->size + 1, sizeof(uint64_t));
+    inc->hashed = calloc(fw->size + 1, sizeof(bool));
+    inc->cached = calloc(fw->size + 1, sizeof(bool));
+    assert(inc->hashes && inc->hashed && inc->cached);
+    if (!fw->incfile)
+        return;
+
+    FILE *stream = fopen(fw->incfile, "r");
+    char *line = NULL;
+    size_t size = 0;
+    while (stream && getline(&line, &size, stream) > 0)
+    {
+        char *name = strtok(line, " \t\n");
+        char *hash = strtok(NULL, " \t\n");
+        if (!name || !hash || *name == '#')
+            continue;
+        inc->passed = realloc(inc->passed, (inc->npassed + 1) * sizeof(struct passed_t));
+        assert(inc->passed);
+        inc->passed[inc->npassed].name = strdup(name);
+        inc->passed[inc->npassed++].hash = strtoull(hash, NULL, 16);
+    }
+    free(line);
+    if (stream)
+        fclose(stream);
+
+    uint64_t hash = hash_settings(fw, mode, FNV_OFFSET);
+    for (int i = 0; i < fw->nhashfiles; i++)
+        hash = hash_file(hash, fw->hashfiles[i]);
+    for (int i = 0; i < fw->size; i++)
+    {
+        struct test_t *t = &fw->tests[i];
+        inc->hashed[i] = hash_test(t, argc, argv, hash, &inc->hashes[i]);
+        char name[256];
+        snprintf(name, sizeof(name), "%s.%s", t->suite, t->name);
+        struct passed_t *p = find_passed(inc, name);
+        inc->cached[i] = inc->hashed[i] && p && p->hash == inc->hashes[i];
+    }
+}
+
+/* update the incremental file with the tests that passed, and keep the other entries */
+static void incremental_end(struct testfw_t *fw, struct incremental_t *inc, int *failures)
+{
+    if (fw->incfile)
+    {
+        for (int i = 0; i < fw->size; i++)
+        {
+            char name[256];
+            snprintf(name, sizeof(name), "%s.%s", fw->tests[i].suite, fw->tests[i].name);
+            struct passed_t *p = find_passed(inc, name);
+            if (!p)
+            {
+                inc->passed = realloc(inc->passed, (inc->npassed + 1) * sizeof(struct passed_t));
+                assert(inc->passed);
+                p = &inc->passed[inc->npassed++];
+                p->name = strdup(name);
+            }
+            p->hash = inc->hashes[i];
+            if (!inc->hashed[i] || failures[i])
+                *p->name = 0; // removed
+        }
+
+        /* save incremental file atomically */
+        char *tmpfile = NULL;
+        asprintf(&tmpfile, "%s.%d", fw->incfile, getpid());
+        assert(tmpfile);
+        FILE *out = fopen(tmpfile, "w");
+        if (out)
+        {
+            fprintf(out, "# testfw incremental: suite.name hash\n");
+            for (int i = 0; i < inc->npassed; i++)
+                if (*inc->passed[i].name)
+                    fprintf(out, "%s %016llx\n", inc->passed[i].name, (unsigned long long)inc->passed[i].hash);
+            if (fclose(out) == 0)
+                rename(tmpfile, fw->incfile);
+            else
+                unlink(tmpfile);
+        }
+        else
+            perror(fw->incfile);
+        free(tmpfile);
+    }
+    for (int i = 0; i < inc->npassed; i++)
+        free(inc->passed[i].name);
+    free(inc->passed);
+    free(inc->hashes);
+    free(inc->hashed);
+    free(inc->cached);
+}
+
+/* report the k-th test, that is not run as it is unchanged since it passed */
+static void report_cached(struct testfw_t *fw, int k)
+{
+    struct test_t *t = &fw->tests[k];
+    if (!fw->silent)
+        printf("%s[CACHED]%s run test \"%s.%s\" (unchanged since it passed)\n", GREEN, NC, t->suite, t->name);
+    fflush(stdout);
+    if (fw->reportfd >= 0)
+    {
+        struct testfw_result_t res;
+        empty_result(fw->order ? fw->order[k] : k, &res);
+        res.cached = true;
+        bool ok = testfw_write_full(fw->reportfd, &res, sizeof(res)); // atomic (less than PIPE_BUF)
+        assert(ok);
+    }
+}
+
+/* ********** RUN ALL TESTS ********** */
+
+/**
+ * In forkp mode, each test has its own worker process, that sends the result of each run through a shared pipe, as soon
+ * as it is over. If CPUs are pinned, at most one worker runs per CPU, and a new worker starts on the CPU slot of a
+ * worker that is over. The pipe is polled periodically, so that a worker that dies without sending all its results
+ * does not block the others.
+ */
+
+#define WORKER_CHECK 100 /* period to check for dead workers (in ms) */
+
+struct workers_t
+{
+    int max;     /* maximal number of running workers */
+    int n;       /* number of running workers */
+    pid_t *pids; /* worker of each test if running, else 0 */
+    int *slots;  /* CPU slot of the worker of each test */
+    bool *busy;  /* if true, a CPU slot is used by a running worker */
+};
+
+static void end_worker(struct workers_t *w, int k)
+{
+    waitpid(w->pids[k], NULL, 0); // may already be reaped
+    w->busy[w->slots[k]] = false;
+    w->pids[k] = 0;
+    w->n--;
+}
+
+/* read a result from a worker, and report its test once all its repetitions are over */
+static bool read_worker(struct testfw_t *fw, int fd, int timeout, struct workers_t *w, struct samples_t *results,
+                        int *failures, struct samples_t *baseline, int nbaseline, bool *eof)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout) <= 0)
+        return false;
+    struct testfw_result_t res;
+    if (!testfw_read_full(fd, &res, sizeof(res)))
+    {
+        *eof = true; // all workers are over
+        return false;
+    }
+    collect_result(fw, results, &res);
+    if (results[res.index].n == fw->repeat)
+    {
+        failures[res.index] = report_test(fw, res.index, results, baseline, nbaseline);
+        if (w->pids[res.index] > 0)
+            end_worker(w, res.index);
+    }
+    return true;
+}
+
+static void run_workers(struct testfw_t *fw, int argc, char *argv[], bool *cached, struct samples_t *results,
+                        int *failures, struct samples_t *baseline, int nbaseline)
+{
+    int pipefd[2];
+    int r = pipe(pipefd);
+    assert(r == 0);
+    fw->resultfd = pipefd[1];
+    struct workers_t w;
+    w.max = (fw->ncpus > 0) ? fw->ncpus : fw->size;
+    w.n = 0;
+    w.pids = calloc(fw->size + 1, sizeof(pid_t));
+    w.slots = calloc(fw->size + 1, sizeof(int));
+    w.busy = calloc(w.max + 1, sizeof(bool));
+    assert(w.pids && w.slots && w.busy);
+
+    int next = 0;
+    bool eof = false;
+    while (true)
+    {
+        for (; next < fw->size && w.n < w.max; next++)
+        {
+            if (cached[next])
+                continue;
+            int slot = 0;
+            while (w.busy[slot])
+                slot++;
+            w.busy[slot] = true;
+            w.slots[next] = slot;
+            w.pids[next] = run_test_forkp(fw, &fw->tests[next], argc, argv, slot);
+            w.n++;
+        }
+        if (next == fw->size && fw->resultfd >= 0)
+        {
+            close(fw->resultfd); // EOF once all workers are over
+            fw->resultfd = -1;
+        }
+        if (w.n == 0)
+            break;
+        if (read_worker(fw, pipefd[0], WORKER_CHECK, &w, results, failures, baseline, nbaseline, &eof))
+            continue;
+
+        /* workers that are over without sending all their results */
+        for (int k = 0; k < next; k++)
+        {
+            int wstatus;
+            if (w.pids[k] <= 0 || waitpid(w.pids[k], &wstatus, eof ? 0 : WNOHANG) != w.pids[k])
+                continue;
+            while (read_worker(fw, pipefd[0], 0, &w, results, failures, baseline, nbaseline, &eof))
+                ; // results sent before exit
+            if (w.pids[k] > 0)
+            {
+                /* report the test with the status of its worker (e.g. killed) */
+                struct samples_t *r = &results[k];
+                if (r->n == 0)
+                {
+                    struct testfw_result_t res;
+                    empty_result(k, &res);
+                    collect_result(fw, results, &res);
+                }
+                if (r->wstatus == 0)
+                    r->wstatus = (wstatus != 0) ? wstatus : (TESTFW_EXIT_FAILURE << 8) & 0xFF00;
+                failures[k] = report_test(fw, k, results, baseline, nbaseline);
+                end_worker(&w, k);
+            }
+        }
+    }
+    close(pipefd[0]);
+    free(w.pids);
+    free(w.slots);
+    free(w.busy);
+}
+
+int testfw_run_all(struct testfw_t *fw, int argc, char *argv[], enum testfw_mode_t mode)
+{
+    assert(fw);
+    struct timespec ts_run, ts_wait;
+    trace_begin(fw, &ts_run);
+    if (fw->statefile)
+        load_statefile(fw);
+
+    int nbaseline = 0;
+    struct samples_t *baseline = fw->baseline ? load_baseline(fw->baseline, &nbaseline) : NULL;
+    if (fw->baseline && !baseline)
+        fprintf(stderr, "Warning: baseline file \"%s\" not found!\n", fw->baseline);
+
+    int *failures = calloc(fw->size + 1, sizeof(int));
+    struct samples_t *results = calloc(fw->size + 1, sizeof(struct samples_t));
+    assert(failures && results);
+    for (int i = 0; i < fw->size; i++)
+    {
+        asprintf(&results[i].name, "%s.%s", fw->tests[i].suite, fw->tests[i].name);
+        results[i].samples = malloc(fw->repeat * sizeof(double));
+        assert(results[i].name && results[i].samples);
+    }
+    if (fw->alloc)
+    {
+        /* tests count their allocations in a mapping shared with the framework */
+        fw->allocslots = mmap(NULL, (fw->size + 1) * sizeof(struct alloc_slot_t), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        assert(fw->allocslots != MAP_FAILED);
+    }
+    struct incremental_t inc;
+    incremental_start(fw, argc, argv, mode, &inc);
+
+    if (mode == TESTFW_FORKP)
+    {
+        for (int i = 0; i < fw->size; i++)
+            if (inc.cached[i])
+                report_cached(fw, i);
+        trace_begin(fw, &ts_wait);
+        run_workers(fw, argc, argv, inc.cached, results, failures, baseline, nbaseline);
+        trace_end(fw, &ts_wait, "framework", "wait", NULL);
+    }
+    else
+    {
+        trace_lane(fw, 1); /* sequential tests run on a single worker lane */
+        fw->tracelane = 1;
+        for (int i = 0; i < fw->size; i++)
+        {
+            struct test_t *t = &fw->tests[i];
+            assert(t);
+            if (inc.cached[i])
+            {
+                report_cached(fw, i);
+                continue;
+            }
+            for (int r = 0; r < fw->repeat; r++)
+            {
+                struct testfw_result_t res;
+                run_test(fw, t, argc, argv, mode, &res);
+                collect_result(fw, results, &res);
+            }
+            failures[i] = report_test(fw, i, results, baseline, nbaseline);
+        }
+        fw->tracelane = 0;
+    }
+
+    int nfailures = 0;
+    for (int i = 0; i < fw->size; i++)
+        nfailures += failures[i];
+
+    if (fw->statefile)
+        save_statefile(fw, failures);
+    incremental_end(fw, &inc, failures);
+    if (fw->savebaseline)
+        save_baseline(fw, results);
+
+    for (int i = 0; i < fw->size; i++)
+    {
+        free(results[i].name);
+        free(results[i].samples);
+    }
+    free(results);
+    free_baseline(baseline, nbaseline);
+    free(failures);
+    if (fw->allocslots)
+        munmap(fw->allocslots, (fw->size + 1) * sizeof(struct alloc_slot_t));
+    fw->allocslots = NULL;
+    trace_end(fw, &ts_run, "framework", "run", NULL);
+    return nfailures;
+}
+
+/* ********** RUN ALL TESTS (ASYNCHRONOUS) ********** */
+
+/**
+ * An asynchronous run forks a supervisor process, that runs all tests as testfw_run_all() does (in silent mode), and
+ * sends the summary result of each test through a pipe as soon as it is over. The read end of this pipe is the
+ * pollable descriptor of the run. The supervisor leads its own process group, so that a run can be cancelled at once.
+ */
+
+struct testfw_run_t
+{
+    struct testfw_t *fw;
+    pid_t pid;     /* supervisor process */
+    int fd;        /* read end of the report pipe */
+    int nfailures; /* number of failures among results read */
+};
+
+struct testfw_run_t *testfw_run_start(struct testfw_t *fw, int argc, char *argv[], enum testfw_mode_t mode)
+{
+    assert(fw);
+    struct testfw_run_t *run = malloc(sizeof(struct testfw_run_t));
+    assert(run);
+    int pipefd[2];
+    int r = pipe2(pipefd, O_CLOEXEC);
+    assert(r == 0);
+    fflush(stdout);
+    fflush(stderr);
+    run->pid = fork();
+    if (run->pid == -1)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (run->pid == 0)
+    {
+        setpgid(0, 0);
+        close(pipefd[0]);
+        fw->reportfd = pipefd[1];
+        fw->silent = true;
+        testfw_run_all(fw, argc, argv, mode);
+        close(pipefd[1]);
+        fflush(stdout); // output of tests in nofork mode
+        fflush(stderr);
+        _exit(EXIT_SUCCESS); // do not run exit handlers of the host
+    }
+    setpgid(run->pid, run->pid); // also set by the supervisor, whichever runs first
+    close(pipefd[1]);
+    run->fw = fw;
+    run->fd = pipefd[0];
+    run->nfailures = 0;
+    return run;
+}
+
+int testfw_run_fd(struct testfw_run_t *run)
+{
+    assert(run);
+    return run->fd;
+}
+
+bool testfw_next_result(struct testfw_run_t *run, struct testfw_result_t *result)
+{
+    assert(run && result);
+    if (run->fd < 0 || !testfw_read_full(run->fd, result, sizeof(struct testfw_result_t)))
+        return false;
+    assert(result->index >= 0 && result->index < run->fw->size);
+    if (result->wstatus != 0 || (result->slower && run->fw->gate) ||
+        alloc_check(run->fw, result->allocs, result->leaked))
+        run->nfailures++;
+    return true;
+}
+
+void testfw_cancel(struct testfw_run_t *run)
+{
+    assert(run);
+    kill(-run->pid, SIGKILL); // supervisor and workers (tests are killed on the death of their parent if isolated)
+    close(run->fd);
+    run->fd = -1;
+}
+
+int testfw_run_end(struct testfw_run_t *run)
+{
+    assert(run);
+    struct testfw_result_t result;
+    while (testfw_next_result(run, &result))
+        ;
+    if (run->fd >= 0)
+        close(run->fd);
+    waitpid(run->pid, NULL, 0);
+    int nfailures = run->nfailures;
+    free(run);
+    return nfailures;
+}
+
+/* ********** RUN DATA-DRIVEN TESTS ********** */
+
+/**
+ * Each row of a data file is an argv vector, either tab-separated (TSV) or whitespace-separated. Blank lines and lines
+ * starting with '#' are ignored. Rows are run by batches in a single forked child, that reports a record for each row
+ * through a pipe. If the child dies (crash, exit or timeout), the current row gets its status and a new child resumes
+ * the batch with the following row.
+ */
+
+struct row_t
+{
+    char *begin;   /* first character of the row (not null-terminated) */
+    size_t length; /* row length, without '\n' */
+    int line;      /* line number in data file */
+};
+
+struct row_result_t
+{
+    int line;    /* line number of the row */
+    int wstatus; /* wait status of the row */
+    double mtime;
+};
+
+struct batch_t
+{
+    struct test_t *t;
+    int slot;           /* worker slot */
+    pid_t pid;
+    int fd;             /* read end of the pipe, else -1 */
+    size_t pos;         /* position of the next row to run */
+    int line;           /* line number at this position */
+    int nrows;          /* number of rows remaining in this batch */
+    struct timespec ts; /* last activity */
+    struct timespec tsbatch; /* start of the batch child (trace) */
+};
+
+/* read the next row at position *pos, and move forward */
+static bool read_row(char *data, size_t size, size_t *pos, int *line, struct row_t *row)
+{
+    while (*pos < size)
+    {
+        char *begin = data + *pos;
+        char *end = memchr(begin, '\n', size - *pos);
+        size_t length = end ? (size_t)(end - begin) : size - *pos;
+        *pos += length + (end ? 1 : 0);
+        (*line)++;
+        if (length > 0 && begin[length - 1] == '\r')
+            length--;
+        if (length == 0 || *begin == '#')
+            continue;
+        row->begin = begin;
+        row->length = length;
+        row->line = *line;
+        return true;
+    }
+    return false;
+}
+
+/* split a row into a null-terminated argv array, stored in a single memory block (to be freed) */
+static char **split_row(struct row_t *row, int *argc)
+{
+    bool tsv = memchr(row->begin, '\t', row->length) != NULL;
+    char **argv = malloc((row->length / 2 + 2) * sizeof(char *) + row->length + 1);
+    assert(argv);
+    char *buf = (char *)(argv + row->length / 2 + 2);
+    memcpy(buf, row->begin, row->length);
+    buf[row->length] = 0;
+    *argc = 0;
+    if (tsv)
+    {
+        for (char *field = buf; field; (*argc)++)
+        {
+            argv[*argc] = field;
+            field = strchr(field, '\t');
+            if (field)
+                *field++ = 0;
+        }
+    }
+    else
+    {
+        for (char *field = strtok(buf, " \t"); field; field = strtok(NULL, " \t"))
+            argv[(*argc)++] = field;
+    }
+    argv[*argc] = NULL;
+    return argv;
+}
+
+static struct row_result_t run_row(struct test_t *t, struct row_t *row)
+{
+    int argc = 0;
+    char **argv = split_row(row, &argc);
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    int status = t->func(argc, argv);
+    struct row_result_t res = {row->line, (status << 8) & 0xFF00, mtime_since(&ts_start)};
+    fflush(stdout);
+    fflush(stderr);
+    free(argv);
+    return res;
+}
+
+static void report_row(struct testfw_t *fw, struct test_t *t, struct row_result_t *res, int *nfailures)
+{
+    if (!fw->silent)
+    {
+        char param[16];
+        snprintf(param, sizeof(param), "%d", res->line);
+        print_diag_test(stdout, t, param, res->wstatus, res->mtime, NULL, NULL);
+    }
+    *nfailures += (WIFEXITED(res->wstatus) && !WEXITSTATUS(res->wstatus)) ? 0 : 1;
+}
+
+static void start_batch(struct testfw_t *fw, char *data, size_t size, struct batch_t *b)
+{
+    int pipefd[2];
+    int r = pipe(pipefd);
+    assert(r == 0);
+    fflush(stdout);
+    fflush(stderr);
+    trace_lane(fw, 1 + b->slot);
+    trace_begin(fw, &b->tsbatch);
+    b->pid = fork();
+    assert(b->pid >= 0);
+    if (b->pid == 0)
+    {
+        close(pipefd[0]);
+        if (fw->logfile)
+        {
+            int fd = open(fw->logfile, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        bench_output(fw);
+        pin_cpu(fw, b->slot);
+        struct row_t row;
+        for (int k = 0; k < b->nrows && read_row(data, size, &b->pos, &b->line, &row); k++)
+        {
+            struct row_result_t res = run_row(b->t, &row);
+            ssize_t w = write(pipefd[1], &res, sizeof(res)); // atomic (less than PIPE_BUF)
+            assert(w == sizeof(res));
+        }
+        exit(EXIT_SUCCESS);
+    }
+    close(pipefd[1]);
+    b->fd = pipefd[0];
+    clock_gettime(CLOCK_MONOTONIC, &b->ts);
+}
+
+/* the batch child is over: report the row it was running (if any), and resume the batch with the next row */
+static void end_batch(struct testfw_t *fw, char *data, size_t size, struct batch_t *b, int wstatus, int *nfailures)
+{
+    close(b->fd);
+    b->fd = -1;
+    if (fw->tracefd >= 0)
+    {
+        char name[256];
+        snprintf(name, sizeof(name), "%s.%s[batch]", b->t->suite, b->t->name);
+        trace_event(fw, 1 + b->slot, &b->tsbatch, "test", name, NULL);
+    }
+    struct row_t row;
+    if (b->nrows > 0 && read_row(data, size, &b->pos, &b->line, &row))
+    {
+        struct row_result_t res = {row.line, wstatus, mtime_since(&b->ts)};
+        report_row(fw, b->t, &res, nfailures);
+        b->nrows--;
+        if (b->nrows > 0)
+            start_batch(fw, data, size, b);
+    }
+}
+
+/* report the rows whose results are written by a batch child, if any (without blocking), else return false */
+static bool read_results(struct testfw_t *fw, char *data, size_t size, struct batch_t *b, int *nfailures)
+{
+    struct pollfd pfd = {b->fd, POLLIN, 0};
+    if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))
+        return false;
+    struct row_result_t res[64];
+    ssize_t n = read(b->fd, res, sizeof(res));
+    if (n <= 0)
+        return false;
+    struct row_t row;
+    for (int i = 0; i < n / (ssize_t)sizeof(struct row_result_t); i++)
+    {
+        report_row(fw, b->t, &res[i], nfailures);
+        read_row(data, size, &b->pos, &b->line, &row);
+        b->nrows--;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b->ts);
+    return true;
+}
+
+static int run_data_forks(struct testfw_t *fw, char *data, size_t size, int batch, int njobs, int *nresults)
+{
+    struct batch_t *batches = calloc(njobs, sizeof(struct batch_t));
+    struct pollfd *pfds = calloc(njobs, sizeof(struct pollfd));
+    assert(batches && pfds);
+    for (int j = 0; j < njobs; j++)
+    {
+        batches[j].fd = -1;
+        batches[j].slot = j;
+    }
+
+    int nfailures = 0;
+    int k = 0;      /* current test */
+    size_t pos = 0; /* position of the next row to distribute */
+    int line = 0;
+    struct row_t row;
+    int running = 0;
+    do
+    {
+        /* distribute the next batches of rows */
+        for (int j = 0; j < njobs && k < fw->size; j++)
+        {
+            struct batch_t *b = &batches[j];
+            if (b->fd >= 0)
+                continue;
+            b->t = &fw->tests[k];
+            b->pos = pos;
+            b->line = line;
+            b->nrows = 0;
+            while (b->nrows < batch && read_row(data, size, &pos, &line, &row))
+                b->nrows++;
+            if (b->nrows == 0 || pos >= size) /* next test */
+            {
+                k++;
+                pos = 0;
+                line = 0;
+            }
+            if (b->nrows == 0)
+                continue;
+            *nresults += b->nrows;
+            start_batch(fw, data, size, b);
+        }
+
+        /* collect row results */
+        running = 0;
+        for (int j = 0; j < njobs; j++)
+        {
+            pfds[j].fd = batches[j].fd;
+            pfds[j].events = POLLIN;
+            running += (batches[j].fd >= 0);
+        }
+        if (running == 0)
+            continue;
+        poll(pfds, njobs, fw->timeout > 0 ? 100 : -1);
+        for (int j = 0; j < njobs; j++)
+        {
+            struct batch_t *b = &batches[j];
+            if (b->fd < 0)
+                continue;
+            if (pfds[j].revents & (POLLIN | POLLHUP))
+            {
+                if (read_results(fw, data, size, b, &nfailures))
+                    continue;
+                int wstatus = 0;
+                waitpid(b->pid, &wstatus, 0);
+                end_batch(fw, data, size, b, wstatus, &nfailures);
+            }
+            else if (fw->timeout > 0 && mtime_since(&b->ts) > fw->timeout * 1000.0)
+            {
+                /* rows may be over since poll(): the timeout is charged to the row that is still running */
+                if (read_results(fw, data, size, b, &nfailures))
+                    continue;
+                kill(b->pid, SIGKILL);
+                waitpid(b->pid, NULL, 0);
+                while (read_results(fw, data, size, b, &nfailures))
+                    ; // written just before the kill
+                end_batch(fw, data, size, b, (TESTFW_EXIT_TIMEOUT << 8) & 0xFF00, &nfailures);
+            }
+        }
+    } while (running > 0 || k < fw->size);
+
+    free(pfds);
+    free(batches);
+    return nfailures;
+}
+
+/* rows run in the framework process, thus without timeout (an alarm would kill the framework itself) */
+static int run_data_nofork(struct testfw_t *fw, char *data, size_t size, int *nresults)
+{
+    int nfailures = 0;
+    for (int k = 0; k < fw->size; k++)
+    {
+        size_t pos = 0;
+        int line = 0;
+        struct row_t row;
+        while (read_row(data, size, &pos, &line, &row))
+        {
+            int saved[2];
+            log_redirect(fw, saved); // as in batch children
+            struct row_result_t res = run_row(&fw->tests[k], &row);
+            log_restore(saved);
+            report_row(fw, &fw->tests[k], &res, &nfailures);
+            (*nresults)++;
+        }
+    }
+    return nfailures;
+}
+
+int testfw_run_data(struct testfw_t *fw, char *datafile, int batch, enum testfw_mode_t mode, int *nresults)
+{
+    assert(fw && datafile && nresults);
+    assert(batch > 0);
+    *nresults = 0;
+    if (fw->cmd)
+    {
+        fprintf(stderr, "Error: external command is not supported with data-driven tests!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = open(datafile, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(datafile);
+        exit(EXIT_FAILURE);
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    assert(data != MAP_FAILED);
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    struct timespec ts_run;
+    trace_begin(fw, &ts_run);
+    int nfailures = 0;
+    if (mode == TESTFW_NOFORK)
+        nfailures = run_data_nofork(fw, data, st.st_size, nresults);
+    else
+    {
+        int njobs = (mode != TESTFW_FORKP) ? 1 : (fw->ncpus > 0) ? fw->ncpus : sysconf(_SC_NPROCESSORS_ONLN);
+        nfailures = run_data_forks(fw, data, st.st_size, batch, njobs > 0 ? njobs : 1, nresults);
+    }
+
+    munmap(data, st.st_size);
+    trace_end(fw, &ts_run, "framework", "run", NULL);
+    return nfailures;
+}
+
+/* ********** FUZZING ********** */
+
+/**
+ * Fork-server fuzzing: a server process is forked once per test, and it forks a fresh child for each input it receives
+ * from the framework through a pipe, so that the cost of an execution is a single fork() of a warm process. Inputs are
+ * argv vectors, mutated from a small corpus (seeded with the test arguments). Inputs that reach a new exit status or
+ * signal are added to the corpus. Crashing inputs (killed by a signal other than SIGALRM) are minimized and saved in
+ * files "crash-<suite>.<name>-<signal>.args" (one argument per line).
+ */
+
+#define FUZZ_MAXARGS 16
+#define FUZZ_MAXLEN 1024
+#define FUZZ_MAXCORPUS 256
+#define FUZZ_MAXMINIMIZE 2000
+
+struct input_t
+{
+    int argc;
+    char *argv[FUZZ_MAXARGS + 1];
+};
+
+static const char *fuzz_values[] = {"", "0", "1", "-1", "2", "7", "10", "16", "255", "256", "-128", "65535", "65536",
+                                    "2147483647", "-2147483648", "4294967295", "4294967296", "9223372036854775807",
+                                    "0x7f", "1e308", "nan", "%s%s%n", "../../../../etc/passwd", "\xff\xfe"};
+
+static unsigned long fuzz_rand(unsigned long *state)
+{
+    /* xorshift64 */
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void input_free(struct input_t *in)
+{
+    for (int i = 0; i < in->argc; i++)
+        free(in->argv[i]);
+    in->argc = 0;
+    in->argv[0] = NULL;
+}
+
+static void input_copy(struct input_t *dst, struct input_t *src)
+{
+    dst->argc = src->argc;
+    for (int i = 0; i < src->argc; i++)
+        dst->argv[i] = strdup(src->argv[i]);
+    dst->argv[dst->argc] = NULL;
+}
+
+static void input_insert(struct input_t *in, int k, const char *arg)
+{
+    assert(in->argc < FUZZ_MAXARGS && k <= in->argc);
+    memmove(in->argv + k + 1, in->argv + k, (in->argc - k + 1) * sizeof(char *));
+    in->argv[k] = strdup(arg);
+    in->argc++;
+}
+
+static void input_delete(struct input_t *in, int k)
+{
+    assert(k < in->argc);
+    free(in->argv[k]);
+    memmove(in->argv + k, in->argv + k + 1, (in->argc - k) * sizeof(char *));
+    in->argc--;
+}
+
+/* mutate a random byte or a random argument, never producing '\0' or '\n' inside an argument */
+static void input_mutate(struct input_t *in, unsigned long *rng)
+{
+    int nvalues = sizeof(fuzz_values) / sizeof(fuzz_values[0]);
+    int op = fuzz_rand(rng) % 8;
+    if (in->argc == 0)
+        op = 4;
+    int k = in->argc ? fuzz_rand(rng) % in->argc : 0;
+    char *arg = in->argc ? in->argv[k] : NULL;
+    size_t len = arg ? strlen(arg) : 0;
+    if (len == 0 && op <= 2)
+        op = 1;
+    if (len >= FUZZ_MAXLEN && op == 1)
+        op = 2;
+    if (in->argc >= FUZZ_MAXARGS && (op == 4 || op == 6))
+        op = 5;
+
+    switch (op)
+    {
+    case 0: /* flip a bit */
+    {
+        size_t i = fuzz_rand(rng) % len;
+        arg[i] ^= 1 << (fuzz_rand(rng) % 8);
+        if (arg[i] == 0 || arg[i] == '\n')
+            arg[i] = 'A';
+        break;
+    }
+    case 1: /* insert a byte */
+    {
+        size_t i = len ? fuzz_rand(rng) % (len + 1) : 0;
+        char c = 1 + fuzz_rand(rng) % 255;
+        in->argv[k] = arg = realloc(arg, len + 2);
+        assert(arg);
+        memmove(arg + i + 1, arg + i, len - i + 1);
+        arg[i] = (c == '\n') ? ' ' : c;
+        break;
+    }
+    case 2: /* delete a byte */
+    {
+        size_t i = fuzz_rand(rng) % len;
+        memmove(arg + i, arg + i + 1, len - i);
+        break;
+    }
+    case 3: /* replace an argument with an interesting value */
+        free(arg);
+        in->argv[k] = strdup(fuzz_values[fuzz_rand(rng) % nvalues]);
+        break;
+    case 4: /* insert an interesting value */
+        input_insert(in, in->argc ? fuzz_rand(rng) % (in->argc + 1) : 0, fuzz_values[fuzz_rand(rng) % nvalues]);
+        break;
+    case 5: /* delete an argument */
+        input_delete(in, k);
+        break;
+    case 6: /* duplicate an argument */
+        input_insert(in, k, arg);
+        break;
+    case 7: /* replace a byte with a digit or a sign, useful for numeric parsers */
+        if (len == 0) // replaced in place, as argv may be full
+        {
+            free(arg);
+            in->argv[k] = strdup("0");
+        }
+        else
+            arg[fuzz_rand(rng) % len] = "0123456789-+."[fuzz_rand(rng) % 13];
+        break;
+    }
+}
+
+/* fork server: run test function in a new child for each input received, and send back its wait status */
+static void fuzz_server(struct testfw_t *fw, struct test_t *t, int fdin, int fdout)
+{
+    int fd = open(fw->logfile ? fw->logfile : "/dev/null", O_WRONLY | O_CREAT | O_APPEND, 0644);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+
+    int header[2]; /* argc, size */
+    char *buf = NULL;
+    while (testfw_read_full(fdin, header, sizeof(header)))
+    {
+        buf = realloc(buf, header[1] + 1);
+        assert(buf);
+        if (!testfw_read_full(fdin, buf, header[1]))
+            break;
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            char *argv[FUZZ_MAXARGS + 1];
+            char *arg = buf;
+            for (int i = 0; i < header[0]; i++, arg += strlen(arg) + 1)
+                argv[i] = arg;
+            argv[header[0]] = NULL;
+            if (fw->timeout > 0)
+                alarm(fw->timeout);
+            int status = t->func(header[0], argv);
+            exit(status);
+        }
+        int wstatus = 0;
+        waitpid(pid, &wstatus, 0);
+        if (!testfw_write_full(fdout, &wstatus, sizeof(wstatus)))
+            break;
+    }
+    free(buf);
+    exit(EXIT_SUCCESS);
+}
+
+struct fuzz_server_t
+{
+    pid_t pid;
+    int fdin;  /* read wait status */
+    int fdout; /* write inputs */
+};
+
+static void fuzz_start(struct testfw_t *fw, struct test_t *t, struct fuzz_server_t *srv)
+{
+    int input[2], output[2];
+    int r = pipe(input);
+    assert(r == 0);
+    r = pipe(output);
+    assert(r == 0);
+    fflush(stdout);
+    fflush(stderr);
+    srv->pid = fork();
+    assert(srv->pid >= 0);
+    if (srv->pid == 0)
+    {
+        pin_cpu(fw, t - fw->tests);
+        close(input[1]);
+        close(output[0]);
+        fuzz_server(fw, t, input[0], output[1]);
+    }
+    close(input[0]);
+    close(output[1]);
+    srv->fdout = input[1];
+    srv->fdin = output[0];
+}
+
+static void fuzz_stop(struct fuzz_server_t *srv)
+{
+    close(srv->fdout);
+    close(srv->fdin);
+    waitpid(srv->pid, NULL, 0);
+}
+
+static int fuzz_exec(struct fuzz_server_t *srv, struct input_t *in)
+{
+    char buf[FUZZ_MAXARGS * (FUZZ_MAXLEN + 2) + 2 * sizeof(int)];
+    int *header = (int *)buf;
+    size_t size = 2 * sizeof(int);
+    for (int i = 0; i < in->argc; i++)
+    {
+        size_t len = strlen(in->argv[i]) + 1;
+        memcpy(buf + size, in->argv[i], len);
+        size += len;
+    }
+    header[0] = in->argc;
+    header[1] = size - 2 * sizeof(int);
+    int wstatus = 0;
+    bool ok = testfw_write_full(srv->fdout, buf, size) && testfw_read_full(srv->fdin, &wstatus, sizeof(wstatus));
+    assert(ok);
+    return wstatus;
+}
+
+static bool is_crash(int wstatus)
+{
+    return WIFSIGNALED(wstatus) && WTERMSIG(wstatus) != SIGALRM;
+}
+
+/* remove arguments, then chunks of arguments, while the input still crashes with the same signal */
+static void fuzz_minimize(struct fuzz_server_t *srv, struct input_t *in, int wstatus)
+{
+    int nexecs = 0;
+    for (int k = in->argc - 1; k >= 0 && nexecs < FUZZ_MAXMINIMIZE; k--)
+    {
+        struct input_t tmp;
+        input_copy(&tmp, in);
+        input_delete(&tmp, k);
+        nexecs++;
+        if (fuzz_exec(srv, &tmp) == wstatus)
+        {
+            input_free(in);
+            *in = tmp;
+        }
+        else
+            input_free(&tmp);
+    }
+    for (int k = 0; k < in->argc; k++)
+    {
+        for (size_t chunk = (strlen(in->argv[k]) + 1) / 2; chunk > 0 && nexecs < FUZZ_MAXMINIMIZE; chunk /= 2)
+        {
+            for (size_t i = 0; i + chunk <= strlen(in->argv[k]) && nexecs < FUZZ_MAXMINIMIZE;)
+            {
+                char *arg = in->argv[k];
+                char *saved = strdup(arg);
+                memmove(arg + i, arg + i + chunk, strlen(arg) - i - chunk + 1);
+                nexecs++;
+                if (fuzz_exec(srv, in) == wstatus)
+                    free(saved);
+                else
+                {
+                    strcpy(arg, saved);
+                    free(saved);
+                    i += chunk;
+                }
+            }
+        }
+    }
+}
+
+static void print_replay(FILE *stream, struct testfw_t *fw, struct test_t *t, struct input_t *in)
+{
+    fprintf(stream, "   replay: %s -r %s.%s --", fw->program, t->suite, t->name);
+    for (int i = 0; i < in->argc; i++)
+    {
+        fputs(" '", stream);
+        for (char *c = in->argv[i]; *c; c++)
+            if (*c == '\'')
+                fputs("'\\''", stream);
+            else
+                fputc(*c, stream);
+        fputc('\'', stream);
+    }
+    fputc('\n', stream);
+}
+
+static void save_crash(struct testfw_t *fw, struct test_t *t, struct input_t *in, int sig)
+{
+    char *filename = NULL;
+    asprintf(&filename, "crash-%s.%s-%d.args", t->suite, t->name, sig);
+    assert(filename);
+    FILE *stream = fopen(filename, "w");
+    if (!stream)
+        perror(filename);
+    else
+    {
+        for (int i = 0; i < in->argc; i++)
+            fprintf(stream, "%s\n", in->argv[i]);
+        fclose(stream);
+    }
+    if (!fw->silent)
+    {
+        printf("%s[KILLED]%s fuzz test \"%s.%s\" with %d argument(s) (signal \"%s\") saved in \"%s\"\n", RED, NC, t->suite, t->name, in->argc, strsignal(sig), filename);
+        print_replay(stdout, fw, t, in);
+    }
+    free(filename);
+}
+
+/* fuzz a single test, and return the number of distinct crashes (one per signal) */
+static int fuzz_test(struct testfw_t *fw, struct test_t *t, int argc, char *argv[], int runs, unsigned long *rng)
+{
+    struct input_t *corpus = malloc(FUZZ_MAXCORPUS * sizeof(struct input_t));
+    assert(corpus);
+    /* seeds: no argument & test arguments */
+    int ncorpus = (argc > 0) ? 2 : 1;
+    corpus[0].argc = 0;
+    corpus[0].argv[0] = NULL;
+    corpus[1].argc = 0;
+    for (int i = 0; i < argc && i < FUZZ_MAXARGS; i++)
+        corpus[1].argv[corpus[1].argc++] = strndup(argv[i], FUZZ_MAXLEN);
+    corpus[1].argv[corpus[1].argc] = NULL;
+    int nseeds = ncorpus;
+
+    bool outcomes[2][256] = {{false}}; /* exit status & signals already seen */
+    bool crashes[NSIG] = {false};
+    int ncrashes = 0;
+
+    struct fuzz_server_t srv;
+    fuzz_start(fw, t, &srv);
+
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    for (int n = 0; n < runs; n++)
+    {
+        struct input_t in;
+        input_copy(&in, &corpus[n < nseeds ? n : fuzz_rand(rng) % ncorpus]);
+        if (n >= nseeds)
+            for (int m = 1 + fuzz_rand(rng) % 4; m > 0; m--)
+                input_mutate(&in, rng);
+
+        int wstatus = fuzz_exec(&srv, &in);
+        bool signaled = WIFSIGNALED(wstatus);
+        int code = (signaled ? WTERMSIG(wstatus) : WEXITSTATUS(wstatus)) & 0xFF;
+
+        if (is_crash(wstatus) && !crashes[WTERMSIG(wstatus)])
+        {
+            crashes[WTERMSIG(wstatus)] = true;
+            ncrashes++;
+            struct timespec ts_minimize;
+            trace_begin(fw, &ts_minimize);
+            fuzz_minimize(&srv, &in, wstatus);
+            trace_end(fw, &ts_minimize, "framework", "minimize", NULL);
+            save_crash(fw, t, &in, WTERMSIG(wstatus));
+        }
+        if (!outcomes[signaled][code] && n >= nseeds && ncorpus < FUZZ_MAXCORPUS)
+            corpus[ncorpus++] = in; /* new behavior */
+        else
+            input_free(&in);
+        outcomes[signaled][code] = true;
+    }
+    double mtime = mtime_since(&ts_start);
+    fuzz_stop(&srv);
+    if (fw->tracefd >= 0)
+    {
+        char name[256];
+        char args[64];
+        snprintf(name, sizeof(name), "fuzz %s.%s", t->suite, t->name);
+        snprintf(args, sizeof(args), "{\"execs\":%d,\"crashes\":%d}", runs, ncrashes);
+        trace_end(fw, &ts_start, "test", name, args);
+    }
+
+    if (!fw->silent)
+        printf("%s%s%s fuzz test \"%s.%s\" with %d inputs in %.2f ms (%.0f exec/s, %d crash(es))\n", ncrashes ? RED : GREEN, ncrashes ? "[KILLED]" : "[SUCCESS]", NC,
+               t->suite, t->name, runs, mtime, mtime > 0 ? runs * 1000.0 / mtime : 0.0, ncrashes);
+
+    for (int i = 0; i < ncorpus; i++)
+        input_free(&corpus[i]);
+    free(corpus);
+    return ncrashes;
+}
+
+int testfw_fuzz(struct testfw_t *fw, int argc, char *argv[], int runs, unsigned long seed)
+{
+    assert(fw);
+    assert(runs > 0);
+    unsigned long rng = seed ? seed : 0x9E3779B97F4A7C15UL;
+    int nfailures = 0;
+    trace_lane(fw, 1);
+    fw->tracelane = 1;
+    for (int i = 0; i < fw->size; i++)
+        nfailures += fuzz_test(fw, &fw->tests[i], argc, argv, runs, &rng) ? 1 : 0;
+    fw->tracelane = 0;
     return nfailures;
 }
@@ -5,6 +5,10 @@
 
 #include <stdbool.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* ********** TEST FRAMEWORK API ********** */
 
 #define TESTFW_VERSION_MAJOR 0
@@ -12,6 +16,8 @@
 #define TESTFW_EXIT_SUCCESS EXIT_SUCCESS
 #define TESTFW_EXIT_FAILURE EXIT_FAILURE
 #define TESTFW_EXIT_TIMEOUT 124
+#define TESTFW_DEFAULT_THRESHOLD 1.5
+#define TESTFW_DEFAULT_ALPHA 0.01
 
 /**
  * @brief execution modes
@@ -38,11 +44,52 @@ struct test_t
     testfw_func_t func; /**< test function */
 };
 
+/**
+ * @brief performance counters (see testfw_set_counters())
+ */
+enum testfw_counter_t
+{
+    TESTFW_COUNTER_INSTRUCTIONS,     /**< instructions (hardware) */
+    TESTFW_COUNTER_CYCLES,           /**< CPU cycles (hardware) */
+    TESTFW_COUNTER_CACHE_MISSES,     /**< last level cache misses (hardware) */
+    TESTFW_COUNTER_BRANCH_MISSES,    /**< branch mispredictions (hardware) */
+    TESTFW_COUNTER_TASK_CLOCK,       /**< task clock in ns (software) */
+    TESTFW_COUNTER_PAGE_FAULTS,      /**< page faults (software) */
+    TESTFW_COUNTER_CONTEXT_SWITCHES, /**< context switches (software) */
+    TESTFW_NCOUNTERS                 /**< number of counters */
+};
+
+/**
+ * @brief test result structure
+ */
+struct testfw_result_t
+{
+    int index;                            /**< test index (see testfw_get()) */
+    int wstatus;                          /**< wait status (first failure over all runs, else 0) */
+    int status;                           /**< exit status, else -1 if killed by a signal */
+    int signal;                           /**< signal that killed the test, else 0 */
+    double mtime;                         /**< duration in ms (median over all runs) */
+    bool slower;                          /**< if true, the test is slower than the baseline */
+    bool cached;                          /**< if true, the test was skipped, as unchanged since it passed */
+    long long counters[TESTFW_NCOUNTERS]; /**< performance counters (mean over all runs), else -1 if not available */
+    long long memory;                     /**< peak memory usage in bytes (maximum over all runs), else -1 */
+    long long cpu;                        /**< CPU usage in us (mean over all runs), else -1 */
+    long long allocs;                     /**< heap allocations (maximum over all runs), else -1 */
+    long long allocated;                  /**< heap bytes allocated (maximum over all runs), else -1 */
+    long long peak;                       /**< peak live heap bytes (maximum over all runs), else -1 */
+    long long leaked;                     /**< heap bytes not freed at test exit (maximum over all runs), else -1 */
+};
+
 /**
  * @brief test framework structure (forward decalaration)
  */
 struct testfw_t;
 
+/**
+ * @brief asynchronous run structure (forward declaration)
+ */
+struct testfw_run_t;
+
 /**
  * @brief initialize test framework
  *
@@ -80,6 +127,182 @@ int testfw_length(struct testfw_t *fw);
  */
 struct test_t *testfw_get(struct testfw_t *fw, int k);
 
+/**
+ * @brief enable the discovery cache
+ *
+ * The symbols of the program are saved in a file "<program>.testfw-cache", keyed by the modification time, the size and
+ * the build-id of the program. As long as the program does not change, the discovery skips the symbol scanning. This
+ * cache is also kept in memory, so that processes forked later (e.g. by a server) do not read it again.
+ *
+ * @param fw the test framework
+ * @param cache if true, use the discovery cache
+ */
+void testfw_set_cache(struct testfw_t *fw, bool cache);
+
+/**
+ * @brief set a state file to run first the tests that failed during the previous run
+ *
+ * Before running, the tests listed in this file are moved in front of the others. After running, the names of all
+ * failed tests are saved in this file. In an asynchronous run, results keep the index of tests in the framework of the
+ * host (see testfw_get()).
+ *
+ * @param fw the test framework
+ * @param statefile the state file, else NULL
+ */
+void testfw_set_statefile(struct testfw_t *fw, char *statefile);
+
+/**
+ * @brief pin each test on a dedicated CPU
+ *
+ * Tests (or workers in forkp mode) are pinned round-robin on the CPUs of the allowed set, in order to get reproducible
+ * durations. In forkp mode, at most one worker runs per CPU at once, so that tests do not share a CPU. This has no
+ * effect in nofork mode.
+ *
+ * @param fw the test framework
+ * @param cpulist a list of CPUs such as "0-3,6", else NULL for all CPUs available to this process
+ * @param reserve if true, the first CPU of the list is reserved for the framework itself, and tests run on the others
+ */
+void testfw_set_affinity(struct testfw_t *fw, char *cpulist, bool reserve);
+
+/**
+ * @brief enable benchmark mode
+ *
+ * In benchmark mode, the priority of the framework and its tests is raised (if privileged) and the test output is
+ * discarded, unless redirected in a log file or an external command.
+ *
+ * @param fw the test framework
+ * @param bench if true, enable benchmark mode
+ */
+void testfw_set_bench(struct testfw_t *fw, bool bench);
+
+/**
+ * @brief run each test in its own cgroup v2, or process group (Linux only)
+ *
+ * A child cgroup is created for each test in a delegated cgroup v2 subtree, detected from the cgroup of the framework
+ * if not given. If no cgroup is available, each test runs in its own process group. Once a test is over (or on
+ * timeout), all its processes are killed. The peak memory and CPU usage of a test in a cgroup are printed in verbose
+ * mode and attached to test events in the trace. This is not used in nofork, data-driven and fuzzing modes.
+ *
+ * As a cgroup that holds processes cannot enable controllers for its children, the framework moves itself into the
+ * leaf cgroup "testfw-<pid>-framework" when the parent cgroup is its own one. If the memory controller still cannot be
+ * enabled, a warning is printed and the peak memory is not measured. testfw_free() undoes these changes: the framework
+ * moves back into its cgroup, and the controllers it has enabled in the parent cgroup are disabled.
+ *
+ * @param fw the test framework
+ * @param cgroup the parent cgroup directory of tests, or NULL to detect it
+ * @param memory_max the memory limit of each test (in bytes), or 0 for no limit (requires a cgroup)
+ * @param cpu_max the CPU bandwidth limit of each test (in CPUs), or 0 for no limit (requires a cgroup)
+ */
+void testfw_set_isolation(struct testfw_t *fw, char *cgroup, long long memory_max, double cpu_max);
+
+/**
+ * @brief measure performance counters of each test (Linux only)
+ *
+ * Counters are opened with perf_event_open() on each test process: instructions, cycles, cache misses and branch
+ * misses if hardware counters are available, else task-clock, page faults and context switches. They are printed in
+ * verbose mode and attached to test events in the trace. This is not supported in data-driven and fuzzing modes.
+ *
+ * @param fw the test framework
+ * @param counters if true, enable performance counters
+ */
+void testfw_set_counters(struct testfw_t *fw, bool counters);
+
+/**
+ * @brief profile heap allocations of each test (glibc only)
+ *
+ * The testfw_alloc object interposes malloc(), calloc(), realloc() and free(), that only count calls and bytes while a
+ * test function runs, using thread-local counters (threads spawned by a test are merged when they exit). It must be
+ * linked in the test program, else allocation profiling is an error: programs that do not link it keep their own
+ * allocator (e.g. AddressSanitizer). The number of allocations, bytes allocated, peak live bytes and bytes leaked at
+ * test exit are printed next to the duration of each test and attached to test events in the trace. A successful test
+ * that exceeds max_allocs is reported as [ALLOCS], and a successful test that leaks is reported as [LEAKED] if
+ * fail_on_leak is set: both count as failures. This is not supported in data-driven and fuzzing modes.
+ *
+ * @param fw the test framework
+ * @param alloc if true, enable allocation profiling
+ * @param max_allocs the maximal number of allocations of a test, or -1 for no limit
+ * @param fail_on_leak if true, a test that leaks memory fails
+ */
+void testfw_set_alloc(struct testfw_t *fw, bool alloc, long long max_allocs, bool fail_on_leak);
+
+/**
+ * @brief run each test several times
+ *
+ * The reported duration is the median of all runs, and a test fails if any run fails.
+ *
+ * @param fw the test framework
+ * @param repeat the number of runs per test (default 1)
+ */
+void testfw_set_repeat(struct testfw_t *fw, int repeat);
+
+/**
+ * @brief compare test durations with a baseline
+ *
+ * A baseline file stores the durations of all runs of each test. A test that succeeds is reported as SLOWER if its
+ * median duration is more than threshold times the baseline one, and if a one-sided Mann-Whitney U test on the
+ * durations is significant at level alpha. Use testfw_set_repeat() to get enough samples (e.g. 5 or more).
+ *
+ * @param fw the test framework
+ * @param baseline the baseline file to compare with, else NULL
+ * @param savebaseline the baseline file in which to save the durations of tests that succeed, else NULL
+ * @param threshold the minimal ratio of median durations (e.g. TESTFW_DEFAULT_THRESHOLD)
+ * @param alpha the significance level (e.g. TESTFW_DEFAULT_ALPHA)
+ * @param gate if true, a SLOWER test counts as a failure
+ */
+void testfw_set_baseline(struct testfw_t *fw, char *baseline, char *savebaseline, double threshold, double alpha, bool gate);
+
+/**
+ * @brief record a timeline of the run in a trace file
+ *
+ * The trace file uses the Chrome trace-event format (JSON), that can be opened in Perfetto or about:tracing. It records
+ * the framework phases (discover, register, fork, wait, flush, external commands) and each test on its worker lane. It
+ * should be set before registering tests, and it is completed by testfw_free().
+ *
+ * @param fw the test framework
+ * @param tracefile the trace file
+ */
+void testfw_set_trace(struct testfw_t *fw, char *tracefile);
+
+/**
+ * @brief skip the tests that are unchanged since they passed (Linux only)
+ *
+ * The hash (FNV-1a) of a test covers the machine code of its function (the range of its dynamic symbol, found with
+ * dladdr1()), its name, the test arguments and the content of the files added with testfw_add_hash_file(). It also
+ * covers the settings that decide whether a test passes: execution mode, timeout, repeat, external command line,
+ * allocation thresholds, isolation limits and the baseline gate (including the baseline file). The files read by the
+ * external command (e.g. an expected output) must be added with testfw_add_hash_file(). A test whose hash matches the
+ * one saved when it last passed is not run, and it is reported as [CACHED]. This is conservative about the test
+ * function itself, but not about the functions and data it uses, unless they are hashed as extra files. A test without
+ * a dynamic symbol (e.g. registered with testfw_register_func() from a static function) always runs. This is not used
+ * in data-driven and fuzzing modes.
+ *
+ * @param fw the test framework
+ * @param incremental if true, enable incremental runs
+ * @param incfile the file of passed tests and their hashes, or NULL for "<program>.testfw-incremental"
+ */
+void testfw_set_incremental(struct testfw_t *fw, bool incremental, char *incfile);
+
+/**
+ * @brief add a file, that tests depend on, to the hash of all tests in incremental runs
+ *
+ * @param fw the test framework
+ * @param path the path of the file (a missing file is hashed as such)
+ */
+void testfw_add_hash_file(struct testfw_t *fw, char *path);
+
+/**
+ * @brief load a shared library of tests
+ *
+ * The library "path/lib<lib>.so" is loaded with dlopen(), and its test functions are discovered together with those of
+ * the program (with concurrent nm processes). Its tests are registered in suites qualified by the library name, as
+ * "<lib>:<suite>". An unqualified suite is registered from the program and from all loaded libraries. Libraries must be
+ * loaded before registering tests.
+ *
+ * @param fw the test framework
+ * @param path the path of the shared library
+ */
+void testfw_add_library(struct testfw_t *fw, char *path);
+
 /**
  * @brief register a single test function
  *
@@ -94,10 +317,14 @@ struct test_t *testfw_register_func(struct testfw_t *fw, char *suite, char *name
 /**
  * @brief register a single test function named "<suite>_<name>""
  *
+ * An unqualified test is registered from the program and all test libraries, as testfw_register_suite() does. In the
+ * program, a static test (see testfw_add_static()) named "<name>" is registered first, if any, else all its static
+ * tests named "<name>[<param>]", else the function "<suite>_<name>".
+ *
  * @param fw the test framework
- * @param suite a suite name in which to register this test
+ * @param suite a suite name in which to register this test (qualified as "<lib>:<suite>" for a single test library)
  * @param name a test name
- * @return a pointer to the structure, that registers this test
+ * @return a pointer to the structure, that registers the first of these tests
  */
 struct test_t *testfw_register_symb(struct testfw_t *fw, char *suite, char *name);
 
@@ -105,11 +332,24 @@ struct test_t *testfw_register_symb(struct testfw_t *fw, char *suite, char *name
  * @brief register all test functions named "<suite>_*"
  *
  * @param fw the test framework
- * @param suite a suite name in which to register these tests
+ * @param suite a suite name in which to register these tests (qualified as "<lib>:<suite>" for a single test library)
  * @return the number of new registered tests
  */
 int testfw_register_suite(struct testfw_t *fw, char *suite);
 
+/**
+ * @brief add a test to the static table of the program, usually before main() (e.g. from a C++ static initializer)
+ *
+ * Static tests are registered as tests of the program by testfw_register_symb() and testfw_register_suite(), without
+ * symbol lookup. The C++ layer (see testfw.hpp) uses this table to register the instantiations of typed and
+ * value-parameterized tests, named "<name>[<param>]".
+ *
+ * @param suite a suite name in which to add this test
+ * @param name a test name
+ * @param func a test function
+ */
+void testfw_add_static(const char *suite, const char *name, testfw_func_t func);
+
 /**
  * @brief run all registered tests
  *
@@ -121,4 +361,96 @@ int testfw_register_suite(struct testfw_t *fw, char *suite);
  */
 int testfw_run_all(struct testfw_t *fw, int argc, char *argv[], enum testfw_mode_t mode);
 
+/**
+ * @brief start running all registered tests in the background
+ *
+ * Tests are run by a supervisor process, as testfw_run_all() does but in silent mode, and the result of each test is
+ * delivered as soon as it is over. The test framework must not be modified until testfw_run_end() is called. Several
+ * runs may be in progress at the same time, for distinct test frameworks.
+ *
+ * @param fw the test framework
+ * @param argc the number of arguments passed to each test function
+ * @param argv the array of arguments passed to each test function
+ * @param mode the execution mode in which to run each test function
+ * @return a pointer on a new asynchronous run structure
+ */
+struct testfw_run_t *testfw_run_start(struct testfw_t *fw, int argc, char *argv[], enum testfw_mode_t mode);
+
+/**
+ * @brief get the file descriptor of an asynchronous run
+ *
+ * This descriptor can be polled (e.g. with poll() or epoll) in an event loop: it becomes readable when a result is
+ * available, or when the run is over.
+ *
+ * @param run the asynchronous run
+ * @return a file descriptor
+ */
+int testfw_run_fd(struct testfw_run_t *run);
+
+/**
+ * @brief get the next test result of an asynchronous run
+ *
+ * This call blocks until a result is available, unless the descriptor of the run is readable.
+ *
+ * @param run the asynchronous run
+ * @param result the result of the next test over (output)
+ * @return true if a result is returned, else false if the run is over
+ */
+bool testfw_next_result(struct testfw_run_t *run, struct testfw_result_t *result);
+
+/**
+ * @brief cancel an asynchronous run
+ *
+ * All tests in progress are killed, and no more result is delivered. testfw_run_end() must still be called.
+ *
+ * @param run the asynchronous run
+ */
+void testfw_cancel(struct testfw_run_t *run);
+
+/**
+ * @brief wait for the end of an asynchronous run and free it
+ *
+ * @param run the asynchronous run to be freed
+ * @return the number of tests that fail (among all delivered results)
+ */
+int testfw_run_end(struct testfw_run_t *run);
+
+/**
+ * @brief run all registered tests once per row of a data file
+ *
+ * Each row of the data file is passed to the test function as an argv vector. Fields are separated by tabulations if
+ * any (TSV), else by spaces. Blank lines and lines starting with '#' are ignored. Each row is reported as a sub-result
+ * named "suite.name[line]". In fork modes, rows are run by batches in a single forked child; if this child crashes, the
+ * rest of the batch is resumed in a new child. In nofork mode, rows run in the framework process, and the timeout is
+ * ignored.
+ *
+ * @param fw the test framework
+ * @param datafile the data file
+ * @param batch the maximum number of rows run in a single forked child
+ * @param mode the execution mode in which to run each batch of rows
+ * @param nresults the total number of rows run (output)
+ * @return the number of rows that fail
+ */
+int testfw_run_data(struct testfw_t *fw, char *datafile, int batch, enum testfw_mode_t mode, int *nresults);
+
+/**
+ * @brief fuzz all registered tests with mutated argv arguments
+ *
+ * For each test, a fork server is started: it forks a fresh child for each input. Inputs are mutated from a corpus
+ * seeded with the given arguments. The first crashing input for each signal is minimized, saved in a file
+ * "crash-<suite>.<name>-<signal>.args" (one argument per line), and a command line to replay it is printed.
+ *
+ * @param fw the test framework
+ * @param argc the number of seed arguments
+ * @param argv the array of seed arguments
+ * @param runs the number of executions per test
+ * @param seed the seed of the random generator (0 for a default seed)
+ * @return the number of tests that crash
+ */
+int testfw_fuzz(struct testfw_t *fw, int argc, char *argv[], int runs, unsigned long seed);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,149 @@
+// Simple Test Framework (testfw), C++ layer
+
+#ifndef TESTFW_HPP
+#define TESTFW_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+#include "testfw.h"
+
+/* ********** C++ TEST REGISTRATION ********** */
+
+/**
+ * C++ tests are added before main() in the static table of the program (see testfw_add_static()), so that they are
+ * registered by testfw_register_symb() and testfw_register_suite() as C tests are, without symbol lookup nor name
+ * mangling issues. Each instantiation of a typed or value-parameterized test has its own test function, registered as
+ * "suite.name[param]", that runs in all execution modes. This requires C++17.
+ *
+ * TESTFW_TEST(suite, name) { ... } defines a test "suite.name".
+ *
+ * TESTFW_TYPED_TEST(suite, name, T1, T2, ...) { ... } defines a test "suite.name[T]" for each type T of the list, that
+ * is named T in the test body. The list can also be given as a testfw::types<T1, T2, ...> alias.
+ *
+ * TESTFW_VALUE_TEST(suite, name, table) { ... } defines a test "suite.name[value]" for each value of a constexpr
+ * table (array or std::array), that is a constexpr reference named param in the test body.
+ */
+
+namespace testfw
+{
+
+/**
+ * @brief a list of types for typed tests
+ */
+template <typename... Ts>
+struct types
+{
+};
+
+/**
+ * @brief the name of a type in typed tests (demangled if possible), that can be specialized before the test
+ */
+template <typename T>
+inline std::string type_name()
+{
+#if defined(__GNUC__)
+    int status = 0;
+    char *name = abi::__cxa_demangle(typeid(T).name(), nullptr, nullptr, &status);
+    if (status == 0 && name)
+    {
+        std::string s(name);
+        std::free(name);
+        return s;
+    }
+#endif
+    return typeid(T).name();
+}
+
+/**
+ * @brief the name of the k-th value in value-parameterized tests: integers, booleans and strings are named by their
+ * value, other values by their index
+ */
+template <typename V>
+inline std::string value_name(const V &value, std::size_t k)
+{
+    if constexpr (std::is_same_v<V, bool>)
+        return value ? "true" : "false";
+    else if constexpr (std::is_integral_v<V>)
+        return std::to_string(value);
+    else if constexpr (std::is_convertible_v<const V &, const char *>)
+        return value;
+    else
+        return std::to_string(k);
+}
+
+namespace detail
+{
+
+inline std::string instance_name(const char *name, const std::string &param)
+{
+    return std::string(name) + "[" + param + "]";
+}
+
+template <template <typename> class Test, typename... Ts>
+inline bool register_typed(const char *suite, const char *name, types<Ts...>)
+{
+    (testfw_add_static(suite, instance_name(name, type_name<Ts>()).c_str(), &Test<Ts>::run), ...);
+    return true;
+}
+
+/* a list given as a single testfw::types<...> alias */
+template <template <typename> class Test, typename... Ts>
+inline bool register_typed(const char *suite, const char *name, types<types<Ts...>>)
+{
+    return register_typed<Test>(suite, name, types<Ts...>{});
+}
+
+template <template <std::size_t> class Test, std::size_t... Is>
+inline bool register_values(const char *suite, const char *name, std::index_sequence<Is...>)
+{
+    (testfw_add_static(suite, instance_name(name, value_name(Test<Is>::param, Is)).c_str(), &Test<Is>::run), ...);
+    return true;
+}
+
+} // namespace detail
+
+} // namespace testfw
+
+#define TESTFW_TEST(suite, name)                                                                                       \
+    struct testfw_test_##suite##_##name                                                                                \
+    {                                                                                                                  \
+        static int run(int argc, char *argv[]);                                                                        \
+    };                                                                                                                 \
+    [[maybe_unused]] static const bool testfw_registered_##suite##_##name =                                           \
+        (testfw_add_static(#suite, #name, &testfw_test_##suite##_##name::run), true);                                 \
+    int testfw_test_##suite##_##name::run([[maybe_unused]] int argc, [[maybe_unused]] char *argv[])
+
+#define TESTFW_TYPED_TEST(suite, name, ...)                                                                            \
+    template <typename T>                                                                                              \
+    struct testfw_test_##suite##_##name                                                                                \
+    {                                                                                                                  \
+        static int run(int argc, char *argv[]);                                                                        \
+    };                                                                                                                 \
+    [[maybe_unused]] static const bool testfw_registered_##suite##_##name =                                           \
+        testfw::detail::register_typed<testfw_test_##suite##_##name>(#suite, #name, testfw::types<__VA_ARGS__>{});     \
+    template <typename T>                                                                                              \
+    int testfw_test_##suite##_##name<T>::run([[maybe_unused]] int argc, [[maybe_unused]] char *argv[])
+
+#define TESTFW_VALUE_TEST(suite, name, table)                                                                          \
+    template <std::size_t I>                                                                                           \
+    struct testfw_test_##suite##_##name                                                                                \
+    {                                                                                                                  \
+        static constexpr const auto &param = table[I];                                                                 \
+        static int run(int argc, char *argv[]);                                                                        \
+    };                                                                                                                 \
+    [[maybe_unused]] static const bool testfw_registered_##suite##_##name =                                           \
+        testfw::detail::register_values<testfw_test_##suite##_##name>(#suite, #name,                                   \
+                                                                      std::make_index_sequence<std::size(table)>{});   \
+    template <std::size_t I>                                                                                           \
+    int testfw_test_##suite##_##name<I>::run([[maybe_unused]] int argc, [[maybe_unused]] char *argv[])
+
+#endif
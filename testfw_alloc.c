@@ -0,0 +1,152 @@
+// Simple Test Framework (testfw), allocation profiling
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <malloc.h>
+
+#include "testfw_alloc.h"
+
+/* ********** ALLOCATION PROFILING ********** */
+
+/**
+ * This object interposes the allocation routines of glibc, and it is only linked in test programs that profile
+ * allocations (see testfw_set_alloc()). The routines count calls and usable bytes only while a test function runs
+ * (alloc_slot is set), else they cost a single load and branch. Each thread counts in its own statistics without
+ * synchronization: the main thread updates the slot of its test in place (a shared mapping, so that counts survive a
+ * crash), and other threads register lazily with a key destructor, that merges their statistics atomically in the slot
+ * when they exit. The peak of live bytes is measured per thread.
+ */
+
+#if defined(__GLIBC__)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static struct alloc_slot_t *alloc_slot = NULL;      /* slot of the running test, else NULL */
+static __thread struct alloc_stats_t *alloc_stats;  /* statistics of the current thread, once registered */
+static __thread struct alloc_stats_t alloc_thread;  /* statistics of a thread spawned by a test */
+static __thread bool alloc_exited;                  /* if true, the statistics of this thread are merged */
+static pthread_key_t alloc_key;
+static bool alloc_key_created = false;
+
+/* merge the statistics of an exiting thread in the slot of the test */
+static void alloc_merge(void *arg)
+{
+    struct alloc_stats_t *s = arg;
+    struct alloc_slot_t *slot = alloc_slot;
+    alloc_stats = NULL;
+    alloc_exited = true; // frees in later destructors are not counted
+    if (!slot)
+        return;
+    __atomic_fetch_add(&slot->threads.nallocs, s->nallocs, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->threads.allocated, s->allocated, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->threads.live, s->live, __ATOMIC_RELAXED);
+    long long peak = __atomic_load_n(&slot->threads.peak, __ATOMIC_RELAXED);
+    while (s->peak > peak &&
+           !__atomic_compare_exchange_n(&slot->threads.peak, &peak, s->peak, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void alloc_count(long long allocated, long long freed)
+{
+    struct alloc_stats_t *s = alloc_stats;
+    if (!s)
+    {
+        if (alloc_exited)
+            return;
+        s = alloc_stats = &alloc_thread; // set first, as pthread_setspecific() may allocate
+        pthread_setspecific(alloc_key, s);
+    }
+    if (allocated > 0)
+    {
+        s->nallocs++;
+        s->allocated += allocated;
+    }
+    s->live += allocated - freed;
+    if (s->live > s->peak)
+        s->peak = s->live;
+}
+
+void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    if (alloc_slot && ptr)
+        alloc_count(malloc_usable_size(ptr), 0);
+    return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *ptr = __libc_calloc(nmemb, size);
+    if (alloc_slot && ptr)
+        alloc_count(malloc_usable_size(ptr), 0);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    size_t freed = (alloc_slot && ptr) ? malloc_usable_size(ptr) : 0;
+    void *newptr = __libc_realloc(ptr, size);
+    if (alloc_slot && (newptr || size == 0)) // realloc(ptr, 0) frees ptr
+        alloc_count(newptr ? malloc_usable_size(newptr) : 0, freed);
+    return newptr;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign(alignment, size);
+    if (alloc_slot && ptr)
+        alloc_count(malloc_usable_size(ptr), 0);
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    void *ptr = memalign(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+void free(void *ptr)
+{
+    if (alloc_slot && ptr)
+        alloc_count(0, malloc_usable_size(ptr));
+    __libc_free(ptr);
+}
+
+void testfw_alloc_start(struct alloc_slot_t *slot)
+{
+    if (!alloc_key_created)
+    {
+        int r = pthread_key_create(&alloc_key, alloc_merge);
+        assert(r == 0);
+        alloc_key_created = true;
+    }
+    memset(slot, 0, sizeof(struct alloc_slot_t));
+    alloc_stats = &slot->main;
+    alloc_slot = slot;
+}
+
+void testfw_alloc_stop(struct alloc_slot_t *slot)
+{
+    alloc_slot = NULL;
+    alloc_stats = NULL;
+}
+
+#endif
@@ -0,0 +1,28 @@
+// Simple Test Framework (testfw), allocation profiling (internal)
+
+#ifndef TESTFW_ALLOC_H
+#define TESTFW_ALLOC_H
+
+/* ********** ALLOCATION PROFILING ********** */
+
+struct alloc_stats_t
+{
+    long long nallocs;   /* calls to malloc(), calloc(), realloc() and aligned variants */
+    long long allocated; /* bytes allocated */
+    long long live;      /* bytes allocated minus bytes freed (may be negative in a thread) */
+    long long peak;      /* peak of live bytes */
+};
+
+struct alloc_slot_t
+{
+    struct alloc_stats_t main;    /* main thread of the test */
+    struct alloc_stats_t threads; /* other threads, once they exit */
+};
+
+/* start counting the allocations of a test in its slot (defined by the testfw_alloc object, if linked) */
+void testfw_alloc_start(struct alloc_slot_t *slot);
+
+/* stop counting allocations, once the test function returns */
+void testfw_alloc_stop(struct alloc_slot_t *slot);
+
+#endif
@@ -0,0 +1,17 @@
+// Simple Test Framework (testfw), internal routines shared by libtestfw and libtestfw_main (not installed)
+
+#ifndef TESTFW_INTERNAL_H
+#define TESTFW_INTERNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ********** I/O ********** */
+
+/* read exactly size bytes from a file descriptor (retried if interrupted by a signal), else return false */
+bool testfw_read_full(int fd, void *buf, size_t size);
+
+/* write exactly size bytes to a file descriptor (retried if interrupted by a signal), else return false */
+bool testfw_write_full(int fd, const void *buf, size_t size);
+
+#endif
@@ -7,19 +7,110 @@
 #include <string.h>
 #include <assert.h>
 #include <getopt.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <libgen.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
 
 #include "testfw.h"
+#include "testfw_internal.h"
 
 #define DEFAULT_MODE TESTFW_FORKS
 #define DEFAULT_SUITE "test"
 #define DEFAULT_TIMEOUT 2
+#define DEFAULT_BATCH 256
+#define DEFAULT_FUZZ_RUNS 10000
+#define DEFAULT_BASELINE_REPEAT 5
+
+#define WATCH_DEBOUNCE 200 // in ms
+#define SERVE_CHECK 500    // in ms
+#define SERVE_BACKLOG 64
+#define SERVE_FD_ENV "TESTFW_SERVE_FD"
 
 enum action_t
 {
     EXECUTE,
-    LIST
+    LIST,
+    FUZZ
+};
+
+/* long options without short equivalent */
+enum option_t
+{
+    OPT_CACHE = 256,
+    OPT_FAILED_FIRST,
+    OPT_WATCH,
+    OPT_DATA,
+    OPT_BATCH,
+    OPT_FUZZ,
+    OPT_SEED,
+    OPT_PIN,
+    OPT_RESERVE_CPU,
+    OPT_BENCH,
+    OPT_COUNTERS,
+    OPT_ISOLATE,
+    OPT_MEMORY_MAX,
+    OPT_CPU_MAX,
+    OPT_ALLOC,
+    OPT_MAX_ALLOCS,
+    OPT_FAIL_ON_LEAK,
+    OPT_INCREMENTAL,
+    OPT_HASH_FILE,
+    OPT_LIB,
+    OPT_SERVE,
+    OPT_CONNECT,
+    OPT_TRACE,
+    OPT_REPEAT,
+    OPT_BASELINE,
+    OPT_SAVE_BASELINE,
+    OPT_SLOWER,
+    OPT_ALPHA,
+    OPT_GATE
 };
 
+static struct option long_options[] = {
+    {"cache", no_argument, NULL, OPT_CACHE},
+    {"failed-first", required_argument, NULL, OPT_FAILED_FIRST},
+    {"watch", no_argument, NULL, OPT_WATCH},
+    {"data", required_argument, NULL, OPT_DATA},
+    {"batch", required_argument, NULL, OPT_BATCH},
+    {"fuzz", optional_argument, NULL, OPT_FUZZ},
+    {"seed", required_argument, NULL, OPT_SEED},
+    {"pin", optional_argument, NULL, OPT_PIN},
+    {"reserve-cpu", no_argument, NULL, OPT_RESERVE_CPU},
+    {"bench", no_argument, NULL, OPT_BENCH},
+    {"counters", no_argument, NULL, OPT_COUNTERS},
+    {"isolate", optional_argument, NULL, OPT_ISOLATE},
+    {"memory-max", required_argument, NULL, OPT_MEMORY_MAX},
+    {"cpu-max", required_argument, NULL, OPT_CPU_MAX},
+    {"alloc", no_argument, NULL, OPT_ALLOC},
+    {"max-allocs", required_argument, NULL, OPT_MAX_ALLOCS},
+    {"fail-on-leak", no_argument, NULL, OPT_FAIL_ON_LEAK},
+    {"incremental", optional_argument, NULL, OPT_INCREMENTAL},
+    {"hash-file", required_argument, NULL, OPT_HASH_FILE},
+    {"lib", required_argument, NULL, OPT_LIB},
+    {"serve", required_argument, NULL, OPT_SERVE},
+    {"connect", required_argument, NULL, OPT_CONNECT},
+    {"trace", required_argument, NULL, OPT_TRACE},
+    {"repeat", required_argument, NULL, OPT_REPEAT},
+    {"baseline", required_argument, NULL, OPT_BASELINE},
+    {"save-baseline", required_argument, NULL, OPT_SAVE_BASELINE},
+    {"slower", required_argument, NULL, OPT_SLOWER},
+    {"alpha", required_argument, NULL, OPT_ALPHA},
+    {"gate", no_argument, NULL, OPT_GATE},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}};
+
 /* ********** USAGE ********** */
 
 void usage(int argc, char *argv[])
@@ -29,19 +120,51 @@ void usage(int argc, char *argv[])
     printf("Register Options:\n");
     printf("  -r <suite.name>: register a function \"suite_name()\" as a test\n");
     printf("  -R <suite>: register all functions \"suite_*()\" as a test suite\n");
+    printf("  --lib <path.so>: also register tests from a shared library \"lib<lib>.so\" (repeatable),\n");
+    printf("                   as suite \"<lib>:<suite>\" (that can be used with -r or -R)\n");
     printf("Actions:\n");
     printf("  -x: execute all registered tests (default action)\n");
     printf("  -l: list all registered tests\n");
+    printf("  --fuzz[=<n>]: fuzz all registered tests with n mutated argv inputs, seeded by testargs [default %d]\n", DEFAULT_FUZZ_RUNS);
+    printf("  --watch: repeat the action each time this program, the expected file or the data file changes\n");
+    printf("  --serve <socket>: serve the command lines of clients on a Unix socket, and reload if this program changes\n");
+    printf("  --connect <socket>: run this command line on a server, and print its output\n");
     printf("Execution Options:\n");
     printf("  -m <mode>: set execution mode: \"forks\"|\"forkp\"|\"nofork\" [default \"forks\"]\n");
     printf("  -d <file>: compare test output with an expected file (using diff)\n");
     printf("  -g <pattern>: search for a pattern in test output (using grep)\n");
+    printf("  --data <file>: run each test once per row of file (tab or space separated arguments)\n");
+    printf("  --batch <n>: run at most n rows of data file in a single forked process [default %d]\n", DEFAULT_BATCH);
+    printf("  --pin[=<cpus>]: pin tests round-robin on CPUs (e.g. \"0-3,6\") [default all available CPUs]\n");
+    printf("  --reserve-cpu: pin the framework on the first CPU, and tests on the others\n");
+    printf("  --bench: benchmark mode (raise priority and discard test output)\n");
+    printf("  --counters: measure performance counters of each test (printed in verbose mode)\n");
+    printf("  --isolate[=<cgroup>]: run each test in its own cgroup v2 (else process group), and kill all its processes\n");
+    printf("                        [default the cgroup of this program, if delegated]\n");
+    printf("  --memory-max <size>: limit the memory of each test (e.g. \"512M\"), requires a cgroup v2\n");
+    printf("  --cpu-max <cpus>: limit the CPU bandwidth of each test (e.g. \"0.5\"), requires a cgroup v2\n");
+    printf("  --alloc: count heap allocations, peak and leaked bytes of each test (printed next to its duration)\n");
+    printf("  --max-allocs <n>: count tests with more than n allocations as failures [ALLOCS] (implies --alloc)\n");
+    printf("  --fail-on-leak: count tests that leak heap memory as failures [LEAKED] (implies --alloc)\n");
+    printf("  --incremental[=<file>]: skip tests whose code and arguments are unchanged since they passed [CACHED]\n");
+    printf("                          [default \"<program>.testfw-incremental\"]\n");
+    printf("  --hash-file <file>: also hash a file that tests depend on, in incremental mode (repeatable)\n");
+    printf("  --seed <n>: set the seed of the fuzzer random generator\n");
+    printf("  --repeat <n>: run each test n times, and report the median duration [default 1, or %d with baseline]\n", DEFAULT_BASELINE_REPEAT);
+    printf("  --baseline <file>: compare test durations with a baseline file, and report [SLOWER] tests\n");
+    printf("  --save-baseline <file>: save test durations in a baseline file\n");
+    printf("  --slower <ratio>: minimal ratio of median durations for a slower test [default %.2f]\n", TESTFW_DEFAULT_THRESHOLD);
+    printf("  --alpha <p>: significance level of the Mann-Whitney U test for a slower test [default %.2f]\n", TESTFW_DEFAULT_ALPHA);
+    printf("  --gate: count slower tests as failures\n");
+    printf("  --failed-first <file>: run first the tests that failed in the previous run saved in file\n");
     printf("Other Options:\n");
     printf("  -o <logfile>: redirect test output to a log file\n");
     printf("  -O: redirect test stdout & stderr to /dev/null\n");
     printf("  -t <timeout>: set time limits for each test (in sec.) [default %d]\n", DEFAULT_TIMEOUT);
     printf("  -T: no timeout\n");
+    printf("  --trace <file>: record a timeline of the run in file (Chrome trace-event format)\n");
     printf("  -c: return the total number of test failures\n");
+    printf("  --cache: cache the test discovery in file \"<program>.testfw-cache\"\n");
     printf("  -s: silent mode (framework only)\n");
     printf("  -S: full silent mode (both framework and test output)\n");
     printf("  -v: verbose mode\n");
@@ -49,6 +172,451 @@ void usage(int argc, char *argv[])
     exit(EXIT_FAILURE);
 }
 
+/* ********** WATCH ********** */
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt_handler(int sig)
+{
+    interrupted = 1;
+}
+
+/* run this program once again (without --watch), in its own process group */
+static pid_t watch_run(char *argv[])
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setpgid(0, 0);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    setpgid(pid, pid);
+    return pid;
+}
+
+static void watch_cancel(pid_t pid)
+{
+    if (pid <= 0)
+        return;
+    kill(-pid, SIGKILL); // kill the whole run, including forked tests
+    waitpid(pid, NULL, 0);
+}
+
+#if defined(__linux__)
+/* return true if an inotify event concerns one of the watched files */
+static bool watch_event(int ifd, int *wds, char **names, int nfiles)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len = read(ifd, buf, sizeof(buf));
+    for (char *ptr = buf; len > 0 && ptr < buf + len;)
+    {
+        struct inotify_event *event = (struct inotify_event *)ptr;
+        for (int k = 0; k < nfiles; k++)
+            if (event->wd == wds[k] && event->len > 0 && strcmp(event->name, names[k]) == 0)
+                changed = true;
+        ptr += sizeof(struct inotify_event) + event->len;
+    }
+    return changed;
+}
+#endif
+
+static int watch_tests(int argc, char *argv[], char *files[], int nfiles)
+{
+#if defined(__linux__)
+    /* failed tests are saved in a state file, to run them first after a change */
+    char statefile[] = "/tmp/testfw-state-XXXXXX";
+    int sfd = mkstemp(statefile);
+    if (sfd < 0)
+    {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    close(sfd);
+
+    /* same command line, without --watch */
+    char **runargv = malloc((argc + 4) * sizeof(char *));
+    assert(runargv);
+    int runargc = 0;
+    runargv[runargc++] = argv[0];
+    runargv[runargc++] = "--cache";
+    runargv[runargc++] = "--failed-first";
+    runargv[runargc++] = statefile;
+    bool testargs = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+            testargs = true;
+        if (testargs || strcmp(argv[i], "--watch") != 0)
+            runargv[runargc++] = argv[i];
+    }
+    runargv[runargc] = NULL;
+
+    /* watch directories rather than files, as linkers often replace the file */
+    int ifd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (ifd < 0)
+    {
+        perror("inotify_init1");
+        exit(EXIT_FAILURE);
+    }
+    int *wds = malloc(nfiles * sizeof(int));
+    char **names = malloc(nfiles * sizeof(char *));
+    char **paths = malloc(2 * nfiles * sizeof(char *));
+    assert(wds && names && paths);
+    for (int k = 0; k < nfiles; k++)
+    {
+        paths[2 * k] = strdup(files[k]);
+        paths[2 * k + 1] = strdup(files[k]);
+        names[k] = basename(paths[2 * k]);
+        wds[k] = inotify_add_watch(ifd, dirname(paths[2 * k + 1]), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB);
+        if (wds[k] < 0)
+        {
+            perror(files[k]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct sigaction act;
+    act.sa_flags = 0;
+    sigemptyset(&act.sa_mask);
+    act.sa_handler = interrupt_handler;
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    pid_t pid = watch_run(runargv);
+    while (!interrupted)
+    {
+        struct pollfd pfd = {ifd, POLLIN, 0};
+        int r = poll(&pfd, 1, WATCH_DEBOUNCE);
+        if (r < 0 && errno != EINTR)
+            break;
+        if (pid > 0 && waitpid(pid, NULL, WNOHANG) == pid)
+        {
+            pid = 0;
+            printf("=> watching for changes...\n");
+            fflush(stdout);
+        }
+        if (r <= 0 || !watch_event(ifd, wds, names, nfiles))
+            continue;
+        /* wait until the build is over, then restart */
+        while (poll(&pfd, 1, WATCH_DEBOUNCE) > 0)
+            watch_event(ifd, wds, names, nfiles);
+        if (pid > 0)
+            printf("=> change detected, cancel the current run...\n");
+        watch_cancel(pid);
+        pid = watch_run(runargv);
+    }
+    watch_cancel(pid);
+
+    close(ifd);
+    for (int k = 0; k < 2 * nfiles; k++)
+        free(paths[k]);
+    free(paths);
+    free(names);
+    free(wds);
+    free(runargv);
+    unlink(statefile);
+    return EXIT_SUCCESS;
+#else
+    fprintf(stderr, "Error: watch mode is not supported on this system!\n");
+    exit(EXIT_FAILURE);
+#endif
+}
+
+/* ********** SERVE ********** */
+
+/**
+ * A server keeps this program loaded, with its tests already discovered (in memory). A client sends its command line
+ * and its working directory through a Unix socket, together with its standard descriptors (SCM_RIGHTS). For each
+ * request, the server forks a handler that runs this command line as a new invocation of main() (with the discovery
+ * cache), so that the output goes straight to the client, and that finally sends the exit status back (processes
+ * forked by the handler, such as tests, do not inherit the client socket). As each request has its own handler, no
+ * state survives from a request to the next one, and the state inherited from the server is reset before main(). The
+ * server checks this program and the test libraries before accepting a request, and re-executes itself (keeping its
+ * listening socket) as soon as one of them changes.
+ */
+
+struct request_t
+{
+    int argc; /* number of arguments */
+    int size; /* size of payload: working directory then arguments, each null terminated */
+};
+
+int main(int argc, char *argv[]);
+
+static int serve_socket(char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: socket path \"%s\" is too long!\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, path);
+    int sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sfd < 0)
+    {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    return sfd;
+}
+
+/* send this command line (without --connect) to a server, and return the exit status of its run */
+static int connect_server(char *path, int argc, char *argv[])
+{
+    int sfd = serve_socket(path);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+    if (connect(sfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        fprintf(stderr, "Error: cannot connect to server \"%s\" (%s)!\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        perror("getcwd");
+        exit(EXIT_FAILURE);
+    }
+    struct request_t req = {0, strlen(cwd) + 1};
+    bool testargs = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+            testargs = true;
+        if (!testargs && strcmp(argv[i], "--connect") == 0)
+            i++; // skip its argument
+        else if (testargs || strncmp(argv[i], "--connect=", 10) != 0)
+        {
+            req.argc++;
+            req.size += strlen(argv[i]) + 1;
+        }
+    }
+    char *payload = malloc(req.size);
+    assert(payload);
+    char *p = stpcpy(payload, cwd) + 1;
+    testargs = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+            testargs = true;
+        if (!testargs && strcmp(argv[i], "--connect") == 0)
+            i++;
+        else if (testargs || strncmp(argv[i], "--connect=", 10) != 0)
+            p = stpcpy(p, argv[i]) + 1;
+    }
+
+    /* send request with standard descriptors */
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    fflush(stdout);
+    if (sendmsg(sfd, &msg, 0) != sizeof(req) || !testfw_write_full(sfd, payload, req.size))
+    {
+        perror("sendmsg");
+        exit(EXIT_FAILURE);
+    }
+    free(payload);
+
+    int status;
+    if (!testfw_read_full(sfd, &status, sizeof(status)))
+    {
+        fprintf(stderr, "Error: server \"%s\" has not returned a status!\n", path);
+        status = EXIT_FAILURE;
+    }
+    close(sfd);
+    return status;
+}
+
+static int serve_client_fd = -1; /* client socket of a handler, only in the handler itself */
+
+/* send the exit status of a handler to its client, once */
+static void serve_status(int status, void *arg)
+{
+    fflush(stdout);
+    fflush(stderr);
+    if (serve_client_fd < 0)
+        return;
+    testfw_write_full(serve_client_fd, &status, sizeof(status));
+    close(serve_client_fd);
+    serve_client_fd = -1;
+}
+
+/* processes forked by a handler (e.g. tests, workers) neither keep its client socket nor send a status on exit */
+static void serve_forked(void)
+{
+    if (serve_client_fd >= 0)
+        close(serve_client_fd);
+    serve_client_fd = -1;
+}
+
+/* handle a request of a client (in a forked process) */
+static void serve_client(int cfd, char *program)
+{
+    struct request_t req;
+    int fds[3];
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *cmsg;
+    if (recvmsg(cfd, &msg, MSG_CMSG_CLOEXEC) != sizeof(req) || !(cmsg = CMSG_FIRSTHDR(&msg)) ||
+        cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)) || req.argc < 0 || req.size <= 0)
+        _exit(EXIT_FAILURE); // invalid request
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    char *payload = malloc(req.size);
+    char **cargv = malloc((req.argc + 3) * sizeof(char *));
+    assert(payload && cargv);
+    if (!testfw_read_full(cfd, payload, req.size) || payload[req.size - 1] != 0)
+        _exit(EXIT_FAILURE);
+
+    /* same command line as the client, with the discovery cache of the server */
+    int cargc = 0;
+    cargv[cargc++] = program;
+    cargv[cargc++] = "--cache";
+    char *p = payload + strlen(payload) + 1;
+    for (int i = 0; i < req.argc && p < payload + req.size; i++, p += strlen(p) + 1)
+        cargv[cargc++] = p;
+    cargv[cargc] = NULL;
+
+    for (int k = 0; k < 3; k++)
+    {
+        dup2(fds[k], k);
+        close(fds[k]);
+    }
+    if (chdir(payload) < 0)
+    {
+        perror(payload);
+        _exit(EXIT_FAILURE);
+    }
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    serve_client_fd = cfd;
+    pthread_atfork(NULL, NULL, serve_forked);
+    on_exit(serve_status, NULL); // also if the run calls exit()
+
+    /* state of the server, but the discovery cache and static tests (in memory) */
+    interrupted = 0;
+    optind = 0; // reinitialize getopt
+    opterr = 1;
+    optarg = NULL;
+    exit(main(cargc, cargv));
+}
+
+/* return true if one of the files has changed since the last call */
+static bool serve_changed(char *files[], struct stat *st, int nfiles)
+{
+    bool changed = false;
+    for (int k = 0; k < nfiles; k++)
+    {
+        struct stat now;
+        if (stat(files[k], &now) < 0)
+            continue; // the file may be replaced by a linker
+        if (now.st_ino != st[k].st_ino || now.st_size != st[k].st_size || now.st_mtim.tv_sec != st[k].st_mtim.tv_sec ||
+            now.st_mtim.tv_nsec != st[k].st_mtim.tv_nsec)
+            changed = true;
+        st[k] = now;
+    }
+    return changed;
+}
+
+static int serve_tests(char *path, int argc, char *argv[], char *files[], int nfiles)
+{
+    /* the listening socket is kept when reloading */
+    char *env = getenv(SERVE_FD_ENV);
+    int sfd = env ? atoi(env) : -1;
+    unsetenv(SERVE_FD_ENV); // not inherited by handlers and tests
+    if (sfd < 0)
+    {
+        sfd = serve_socket(path);
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        strcpy(addr.sun_path, path);
+        unlink(path); // previous server
+        if (bind(sfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sfd, SERVE_BACKLOG) < 0)
+        {
+            fprintf(stderr, "Error: cannot listen on socket \"%s\" (%s)!\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        printf("=> serving on socket \"%s\"...\n", path);
+        fflush(stdout);
+    }
+    fcntl(sfd, F_SETFD, FD_CLOEXEC);
+
+    /* clients run this program from their own working directory */
+    char program[PATH_MAX];
+    if (!realpath(argv[0], program))
+    {
+        perror(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    struct stat *st = calloc(nfiles, sizeof(struct stat));
+    assert(st);
+    serve_changed(files, st, nfiles);
+
+    struct sigaction act;
+    act.sa_flags = 0;
+    sigemptyset(&act.sa_mask);
+    act.sa_handler = interrupt_handler;
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+    signal(SIGCHLD, SIG_IGN); // handlers are reaped automatically
+
+    while (!interrupted)
+    {
+        struct pollfd pfd = {sfd, POLLIN, 0};
+        int r = poll(&pfd, 1, SERVE_CHECK);
+        if (r < 0 && errno != EINTR)
+            break;
+
+        /* reload before accepting a request, pending requests are kept in the socket backlog */
+        if (serve_changed(files, st, nfiles))
+        {
+            while (poll(NULL, 0, WATCH_DEBOUNCE) == 0 && serve_changed(files, st, nfiles))
+                ; // wait until the build is over
+            printf("=> change detected, reload...\n");
+            fflush(stdout);
+            char value[16];
+            snprintf(value, sizeof(value), "%d", sfd);
+            setenv(SERVE_FD_ENV, value, 1);
+            fcntl(sfd, F_SETFD, 0);
+            signal(SIGCHLD, SIG_DFL);
+            execv(program, argv);
+            perror(program);
+            exit(EXIT_FAILURE);
+        }
+        if (r <= 0)
+            continue;
+
+        int cfd = accept4(sfd, NULL, NULL, SOCK_CLOEXEC);
+        if (cfd < 0)
+            continue;
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(sfd);
+            serve_client(cfd, program);
+        }
+        close(cfd);
+    }
+
+    close(sfd);
+    unlink(path);
+    free(st);
+    return EXIT_SUCCESS;
+}
+
 /* ********** MAIN ********** */
 
 int main(int argc, char *argv[])
@@ -65,8 +633,49 @@ int main(int argc, char *argv[])
     enum action_t action = EXECUTE;         // default action
     char *suite = DEFAULT_SUITE;            // default suite
     char *name = NULL;
+    char *suitebuf = NULL;
+    bool cache = false;                     // discovery cache
+    char *statefile = NULL;                 // failed-first state file
+    char **watchfiles = calloc(argc + 1, sizeof(char *)); // files to watch
+    assert(watchfiles);
+    watchfiles[0] = argv[0];
+    int nwatchfiles = 1;
+    char **libs = calloc(argc + 1, sizeof(char *)); // test libraries
+    assert(libs);
+    int nlibs = 0;
+    char **hashfiles = calloc(argc + 1, sizeof(char *)); // extra files hashed in incremental mode
+    assert(hashfiles);
+    int nhashfiles = 0;
+    bool watch = false;                     // watch mode
+    char *servesocket = NULL;               // server mode
+    char *connectsocket = NULL;             // client mode
+    char *datafile = NULL;                  // data-driven tests
+    int batch = DEFAULT_BATCH;              // rows per forked process
+    int runs = DEFAULT_FUZZ_RUNS;           // fuzz executions per test
+    unsigned long seed = 0;                 // fuzz seed
+    bool pin = false;                       // CPU pinning
+    char *cpulist = NULL;                   // allowed CPUs (all by default)
+    bool reserve = false;                   // reserve a CPU for the framework
+    bool bench = false;                     // benchmark mode
+    bool counters = false;                  // performance counters
+    bool isolate = false;                   // cgroup or process group per test
+    char *cgroup = NULL;                    // parent cgroup (detected by default)
+    long long memory_max = 0;               // memory limit per test
+    double cpu_max = 0;                     // CPU limit per test
+    bool alloc = false;                     // allocation profiling
+    long long max_allocs = -1;              // allocations per test (no limit by default)
+    bool fail_on_leak = false;              // leaking tests are failures
+    bool incremental = false;               // skip unchanged tests that passed
+    char *incfile = NULL;                   // incremental file (default by program)
+    char *tracefile = NULL;                 // trace file
+    int repeat = 0;                         // runs per test (0 for default)
+    char *baseline = NULL;                  // baseline file
+    char *savebaseline = NULL;              // baseline file to save
+    double threshold = TESTFW_DEFAULT_THRESHOLD;
+    double alpha = TESTFW_DEFAULT_ALPHA;
+    bool gate = false;                      // slower tests are failures
 
-    while ((opt = getopt(argc, argv, "g:d:vr:R:t:Tm:sSco:Olxh?")) != -1)
+    while ((opt = getopt_long(argc, argv, "g:d:vr:R:t:Tm:sSco:Olxh?", long_options, NULL)) != -1)
     {
         switch (opt)
         {
@@ -79,8 +688,9 @@ int main(int argc, char *argv[])
                 fprintf(stderr, "Error: invalid test name \"%s\"!\n", optarg);
                 exit(EXIT_FAILURE);
             }
-            *sep = 0;
-            suite = optarg;
+            free(suitebuf); // optarg is left untouched, as argv may be reused in watch mode
+            suitebuf = strndup(optarg, sep - optarg);
+            suite = suitebuf;
             name = sep + 1;
             break;
         }
@@ -137,6 +747,8 @@ int main(int argc, char *argv[])
         case 'd':
             assert(cmd == NULL && logfile == NULL);
             asprintf(&cmd, "diff %s -", optarg);
+            hashfiles[nhashfiles++] = optarg; // the expected output decides whether tests pass
+            watchfiles[nwatchfiles++] = optarg;
             break;
         case 'g':
             assert(cmd == NULL && logfile == NULL);
@@ -145,6 +757,157 @@ int main(int argc, char *argv[])
         case 'v':
             verbose = true;
             break;
+        case OPT_FUZZ:
+            action = FUZZ;
+            if (optarg)
+                runs = atoi(optarg);
+            if (runs <= 0)
+            {
+                fprintf(stderr, "Error: invalid number of fuzz runs \"%s\"!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_SEED:
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_PIN:
+            pin = true;
+            cpulist = optarg;
+            break;
+        case OPT_RESERVE_CPU:
+            pin = true;
+            reserve = true;
+            break;
+        case OPT_BENCH:
+            bench = true;
+            break;
+        case OPT_COUNTERS:
+            counters = true;
+            break;
+        case OPT_ISOLATE:
+            isolate = true;
+            cgroup = optarg;
+            break;
+        case OPT_MEMORY_MAX:
+        {
+            char *end;
+            char *units = "KMG";
+            isolate = true;
+            memory_max = strtoll(optarg, &end, 10);
+            char *unit = *end ? strchr(units, *end) : NULL;
+            if (unit && end[1] == 0)
+                memory_max <<= 10 * (unit - units + 1);
+            if (memory_max <= 0 || (*end && (!unit || end[1])))
+            {
+                fprintf(stderr, "Error: invalid memory limit \"%s\"!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        case OPT_ALLOC:
+            alloc = true;
+            break;
+        case OPT_MAX_ALLOCS:
+        {
+            char *end;
+            alloc = true;
+            max_allocs = strtoll(optarg, &end, 10);
+            if (max_allocs < 0 || *end || end == optarg)
+            {
+                fprintf(stderr, "Error: invalid number of allocations \"%s\"!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        case OPT_FAIL_ON_LEAK:
+            alloc = true;
+            fail_on_leak = true;
+            break;
+        case OPT_SERVE:
+            servesocket = optarg;
+            break;
+        case OPT_CONNECT:
+            connectsocket = optarg;
+            break;
+        case OPT_INCREMENTAL:
+            incremental = true;
+            incfile = optarg;
+            break;
+        case OPT_HASH_FILE:
+            hashfiles[nhashfiles++] = optarg;
+            watchfiles[nwatchfiles++] = optarg;
+            break;
+        case OPT_LIB:
+            libs[nlibs++] = optarg;
+            watchfiles[nwatchfiles++] = optarg;
+            break;
+        case OPT_CPU_MAX:
+            isolate = true;
+            cpu_max = atof(optarg);
+            if (cpu_max <= 0.0)
+            {
+                fprintf(stderr, "Error: invalid CPU limit \"%s\"!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_TRACE:
+            tracefile = optarg;
+            break;
+        case OPT_REPEAT:
+            repeat = atoi(optarg);
+            if (repeat <= 0)
+            {
+                fprintf(stderr, "Error: invalid number of runs \"%s\"!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_BASELINE:
+            baseline = optarg;
+            break;
+        case OPT_SAVE_BASELINE:
+            savebaseline = optarg;
+            break;
+        case OPT_SLOWER:
+            threshold = atof(optarg);
+            if (threshold < 1.0)
+            {
+                fprintf(stderr, "Error: invalid slowdown ratio \"%s\"!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_ALPHA:
+            alpha = atof(optarg);
+            if (alpha <= 0.0 || alpha >= 1.0)
+            {
+                fprintf(stderr, "Error: invalid significance level \"%s\"!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_GATE:
+            gate = true;
+            break;
+        case OPT_CACHE:
+            cache = true;
+            break;
+        case OPT_FAILED_FIRST:
+            statefile = optarg;
+            break;
+        case OPT_WATCH:
+            watch = true;
+            break;
+        case OPT_DATA:
+            assert(datafile == NULL);
+            datafile = optarg;
+            watchfiles[nwatchfiles++] = optarg;
+            break;
+        case OPT_BATCH:
+            batch = atoi(optarg);
+            if (batch <= 0)
+            {
+                fprintf(stderr, "Error: invalid batch size \"%s\"!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case '?':
         case 'h':
         default:
@@ -153,13 +916,62 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (watch && servesocket)
+    {
+        fprintf(stderr, "Error: watch mode is not compatible with server mode!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* watch mode */
+    if (watch)
+    {
+        free(cmd);
+        free(suitebuf);
+        free(libs);
+        free(hashfiles);
+        int status = watch_tests(argc, argv, watchfiles, nwatchfiles);
+        free(watchfiles);
+        return status;
+    }
+
+    /* client mode */
+    if (connectsocket)
+    {
+        free(cmd);
+        free(suitebuf);
+        free(libs);
+        free(hashfiles);
+        free(watchfiles);
+        return connect_server(connectsocket, argc, argv);
+    }
+
     /* external command */
 
     int testargc = argc - optind;
     char **testargv = argv + optind;
     struct testfw_t *fw = testfw_init(argv[0], timeout, logfile, cmd, silent, verbose);
+    if (tracefile)
+        testfw_set_trace(fw, tracefile);
+    testfw_set_cache(fw, cache || servesocket); // discovery is kept in memory for handlers
+    testfw_set_statefile(fw, statefile);
+    if (pin)
+        testfw_set_affinity(fw, cpulist, reserve);
+    testfw_set_bench(fw, bench);
+    testfw_set_counters(fw, counters);
+    testfw_set_alloc(fw, alloc, max_allocs, fail_on_leak);
+    testfw_set_incremental(fw, incremental, incfile);
+    for (int i = 0; i < nhashfiles; i++)
+        testfw_add_hash_file(fw, hashfiles[i]);
+    if (isolate)
+        testfw_set_isolation(fw, cgroup, memory_max, cpu_max);
+    if (repeat == 0)
+        repeat = (baseline || savebaseline) ? DEFAULT_BASELINE_REPEAT : 1;
+    testfw_set_repeat(fw, repeat);
+    testfw_set_baseline(fw, baseline, savebaseline, threshold, alpha, gate);
 
     /* register tests */
+    for (int i = 0; i < nlibs; i++)
+        testfw_add_library(fw, libs[i]);
     if (suite && name)
         testfw_register_symb(fw, suite, name);
     else if (suite)
@@ -173,6 +985,19 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    /* server mode (tests are now discovered) */
+    if (servesocket)
+    {
+        testfw_free(fw);
+        free(cmd);
+        free(suitebuf);
+        free(libs);
+        free(hashfiles);
+        int status = serve_tests(servesocket, argc, argv, watchfiles, nwatchfiles);
+        free(watchfiles);
+        return status;
+    }
+
     /* actions */
     int nfailures = 0;
     if (action == LIST)
@@ -183,24 +1008,36 @@ int main(int argc, char *argv[])
             printf("%s.%s\n", test->suite, test->name);
         }
     }
+    else if (action == EXECUTE && datafile)
+    {
+        nfailures = testfw_run_data(fw, datafile, batch, mode, &length);
+    }
     else if (action == EXECUTE)
     {
         nfailures = testfw_run_all(fw, testargc, testargv, mode);
     }
+    else if (action == FUZZ)
+    {
+        nfailures = testfw_fuzz(fw, testargc, testargv, runs, seed);
+    }
     else
         usage(argc, argv);
 
     /* final diagnostic */
-    if (action == EXECUTE && !silent)
+    if ((action == EXECUTE || action == FUZZ) && !silent && length > 0)
         printf("=> %.f%% tests passed, %d tests failed out of %d\n", (length - nfailures) * 100.0 / length, nfailures, length);
 
     /* free tests */
     testfw_free(fw);
+    free(libs);
+    free(hashfiles);
+    free(watchfiles);
 
     if (count || mode == TESTFW_NOFORK)
         return nfailures;
 
     free(cmd);
+    free(suitebuf);
 
     return EXIT_SUCCESS;
 }